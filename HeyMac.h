@@ -13,10 +13,21 @@ enum
     HM_SHORT_ADDR_SZ = 16 / 8,
     HM_IDENT_NAME_SZ = 64,
     HM_IDENT_TAC_ID_SZ = 16,
+    HM_MIC_KEY_SZ = 128 / 8, // AES-128
 
     // item counts (not size)
-    HM_FRMBUF_POOL_CNT = 4,
     HM_TX_QUEUE_CNT = 8,
+    HM_MIC_KEY_CNT = 4, // peers with a cached key schedule
+    HM_EXT_HNDLR_CNT = 4, // registered eXtended frame handlers
+    HM_FRM_BATCH_CNT = 16, // frames per HeyMacFrameBatch
+    HM_RX_QUEUE_CNT = 4, // received frames waiting for the upper layer (power of two)
+    HM_FRMBUF_HDRM_CNT = 4, // frames outside the queues: being rx'd, being tx'd, a beacon or relay, one the app is filling
+    HM_TX_HELD_CNT = 2 * HM_TX_QUEUE_CNT, // TX frames held at once: a full TX ring plus a full TX schedule
+    HM_FRMBUF_POOL_CNT = HM_TX_HELD_CNT + HM_RX_QUEUE_CNT + HM_FRMBUF_HDRM_CNT,
+    HM_FLOOD_DUP_CNT = 32, // (SrcAddr, Seq) pairs the flood duplicate cache remembers (power of two)
+    HM_NGBR_CNT = 16, // neighbors in the neighbor table (power of two)
+    HM_ROUTE_CNT = 16, // destinations in the routing table
+    HM_ROUTE_CACHE_CNT = 8, // direct-mapped route cache slots (power of two)
 };
 
 
@@ -25,6 +36,7 @@ typedef enum
     HM_RET_OK       = 0,
     HM_RET_ERR      = 1,
     HM_RET_NOT_IMPL = 2,
+    HM_RET_FULL     = 3,
 } hm_retval_t;
 
 
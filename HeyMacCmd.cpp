@@ -3,31 +3,75 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "mbed.h"
+
 #include "HeyMac.h"
 #include "HeyMacCmd.h"
 #include "HeyMacFrame.h"
+#include "HeyMacTxtz.h"
+#include "utl_be.h"
 
 
-typedef uint8_t hm_cid_t8;
-enum
-{
-    HM_CID_INVALID = 0,
-    HM_CID_SBCN = 1,
-    HM_CID_EBCN = 2,
-    HM_CID_TXT = 3,
-    HM_CID_CBCN = 4,
-    HM_CID_JOIN = 5,
-};
-
 static uint8_t const CMD_IDX = 0;
 static uint8_t const CMD_PREFIX = 0x80;
 static uint8_t const CMD_PREFIX_MASK = 0xC0;
 static uint8_t const CMD_MASK = 0x3F;
 
+/* A frame's size must fit in the radio's 8-bit payload length */
+static uint16_t const FRM_SZ_MAX = UINT8_MAX;
+
+/* Size of the record header in an aggregated payload */
+static uint8_t const AGG_REC_HDR_SZ = 1;
+
+/* Sizes of the fixed parts of commands, not counting the CID octet */
+static uint8_t const SBCN_SZ = 1 + 2 + 2 + 4;
+static uint8_t const CBCN_SZ = 2 + 2;
+static uint8_t const JOIN_SZ = 1 + 2 + 2;
+static uint8_t const RTE_SZ = 2 + 1;
+static uint8_t const RTE_ADV_SZ = 2 + 2 + 1;
+
+/* CBCN neighbor list */
+static uint8_t const CBCN_NGBR_DELTA = 0x80;
+static uint8_t const CBCN_NGBR_SEQ_MASK = 0x7F;
+static uint8_t const CBCN_LQ_MAX = 0x0F;
+
+/* Varints hold 7 bits per octet, least significant group first */
+static uint8_t const VARINT_MORE = 0x80;
+static uint8_t const VARINT_MASK = 0x7F;
+static uint8_t const VARINT_U16_SZ_MAX = 3;
+
+static uint8_t s_varint_sz(uint16_t v);
+static uint8_t s_varint_put(uint8_t *p, uint16_t v);
+static uint8_t s_varint_get(uint8_t const *p, uint8_t sz, uint16_t *r_v);
+
+typedef bool (*cmd_dec_t)(uint8_t const *cmd, uint8_t sz, hm_cmd_t *r_cmd);
+
+static bool s_dec_sbcn(uint8_t const *cmd, uint8_t sz, hm_cmd_t *r_cmd);
+static bool s_dec_ebcn(uint8_t const *cmd, uint8_t sz, hm_cmd_t *r_cmd);
+static bool s_dec_txt(uint8_t const *cmd, uint8_t sz, hm_cmd_t *r_cmd);
+static bool s_dec_cbcn(uint8_t const *cmd, uint8_t sz, hm_cmd_t *r_cmd);
+static bool s_dec_join(uint8_t const *cmd, uint8_t sz, hm_cmd_t *r_cmd);
+static bool s_dec_rte(uint8_t const *cmd, uint8_t sz, hm_cmd_t *r_cmd);
+
+/** Decoders indexed by CID (nullptr for CIDs that are not defined) */
+static cmd_dec_t const s_dec_lut[HM_CID_CNT] =
+{
+    /* HM_CID_INVALID */ nullptr,
+    /* HM_CID_SBCN */    s_dec_sbcn,
+    /* HM_CID_EBCN */    s_dec_ebcn,
+    /* HM_CID_TXT */     s_dec_txt,
+    /* HM_CID_CBCN */    s_dec_cbcn,
+    /* HM_CID_JOIN */    s_dec_join,
+    /* HM_CID_AGG */     nullptr, /* handled by HeyMacCmdDispatch */
+    /* HM_CID_TXTZ */    s_dec_txt,
+    /* HM_CID_RTE */     s_dec_rte,
+};
+
 
 HeyMacCmd::HeyMacCmd()
 {
     _frm = nullptr;
+    _aggregate = false;
 }
 
 HeyMacCmd::~HeyMacCmd()
@@ -35,47 +79,574 @@ HeyMacCmd::~HeyMacCmd()
 }
 
 
-void HeyMacCmd::cmd_init(HeyMacFrame *frm)
+void HeyMacCmd::cmd_init(HeyMacFrame *frm, bool aggregate)
 {
+    uint8_t *payld;
+
     _frm = frm;
+    _aggregate = aggregate;
+
+    if (aggregate)
+    {
+        payld = _frm->get_payld();
+        payld[CMD_IDX] = CMD_PREFIX | HM_CID_AGG;
+        _frm->set_payld_sz(1);
+    }
+}
+
+
+void HeyMacCmd::cmd_chain(HeyMacFrame *next)
+{
+    _frm->set_pending(true);
+    cmd_init(next, _aggregate);
+}
+
+
+bool HeyMacCmd::cmd_sbcn(hm_cmd_sbcn_t const *sbcn)
+{
+    bool success = false;
+    uint8_t *cmd = _alloc(1 + SBCN_SZ);
+
+    if (cmd)
+    {
+        cmd[CMD_IDX] = CMD_PREFIX | HM_CID_SBCN;
+        _put_sbcn(&cmd[CMD_IDX + 1], sbcn);
+        success = true;
+    }
+    return success;
+}
+
+
+bool HeyMacCmd::cmd_ebcn(hm_cmd_sbcn_t const *sbcn, uint16_t const *ngbrs, uint8_t const ngbr_cnt)
+{
+    bool success = false;
+    uint16_t const sz = 1 + SBCN_SZ + 1 + 2 * ngbr_cnt;
+    uint8_t *cmd = nullptr;
+    uint8_t *p;
+
+    if (sz <= FRM_SZ_MAX)
+    {
+        cmd = _alloc(sz);
+    }
+    if (cmd)
+    {
+        cmd[CMD_IDX] = CMD_PREFIX | HM_CID_EBCN;
+        _put_sbcn(&cmd[CMD_IDX + 1], sbcn);
+        p = &cmd[CMD_IDX + 1 + SBCN_SZ];
+        *p++ = ngbr_cnt;
+        for (uint8_t i = 0; i < ngbr_cnt; i++)
+        {
+            be16_st(p, ngbrs[i]);
+            p += 2;
+        }
+        success = true;
+    }
+    return success;
 }
 
 
 bool HeyMacCmd::cmd_txt(char const * const txt, uint8_t const sz)
 {
     bool success = false;
-    uint8_t *payld = nullptr;
-    uint16_t offset = _frm->get_frm_sz();
+    uint8_t z[FRM_SZ_MAX];
+    uint8_t const z_sz = HeyMacTxtz::compress(txt, sz, z, sizeof(z));
+    uint8_t *cmd;
+
+    if (z_sz > 0)
+    {
+        cmd = _alloc(1 + z_sz);
+        if (cmd)
+        {
+            cmd[CMD_IDX] = CMD_PREFIX | HM_CID_TXTZ;
+            memcpy(&cmd[CMD_IDX + 1], z, z_sz);
+            success = true;
+        }
+    }
+    else
+    {
+        cmd = _alloc(1 + sz);
+        if (cmd)
+        {
+            cmd[CMD_IDX] = CMD_PREFIX | HM_CID_TXT;
+            memcpy(&cmd[CMD_IDX + 1], txt, sz);
+            success = true;
+        }
+    }
+    return success;
+}
+
+
+bool HeyMacCmd::cmd_cbcn(uint16_t const caps, uint16_t const status, hm_cbcn_lists_t const *lists)
+{
+    bool success = true;
+    uint16_t sz = 1 + CBCN_SZ;
+    uint16_t prev = 0;
+    uint8_t *cmd = nullptr;
+    uint8_t *p;
+    uint8_t i;
+
+    /* Size the lists and check the neighbors are sorted */
+    if (lists)
+    {
+        sz += 1 + 2 * lists->net_cnt + 2 + (lists->ngbr_cnt + 1) / 2;
+        for (i = 0; success && (i < lists->ngbr_cnt); i++)
+        {
+            success = ((i == 0) || (lists->ngbrs[i].addr > prev))
+                   && (lists->ngbrs[i].lq <= CBCN_LQ_MAX);
+            sz += s_varint_sz(lists->ngbrs[i].addr - prev);
+            prev = lists->ngbrs[i].addr;
+        }
+    }
+
+    if (success && (sz <= FRM_SZ_MAX))
+    {
+        cmd = _alloc(sz);
+    }
+    success = (cmd != nullptr);
+    if (success)
+    {
+        cmd[CMD_IDX] = CMD_PREFIX | HM_CID_CBCN;
+        be16_st(&cmd[CMD_IDX + 1], caps);
+        be16_st(&cmd[CMD_IDX + 3], status);
+    }
+
+    if (success && lists)
+    {
+        p = &cmd[CMD_IDX + 1 + CBCN_SZ];
+        *p++ = lists->net_cnt;
+        for (i = 0; i < lists->net_cnt; i++)
+        {
+            be16_st(p, lists->nets[i]);
+            p += 2;
+        }
+
+        *p++ = (lists->delta ? CBCN_NGBR_DELTA : 0) | (lists->seq & CBCN_NGBR_SEQ_MASK);
+        *p++ = lists->ngbr_cnt;
+        prev = 0;
+        for (i = 0; i < lists->ngbr_cnt; i++)
+        {
+            p += s_varint_put(p, lists->ngbrs[i].addr - prev);
+            prev = lists->ngbrs[i].addr;
+        }
+        memset(p, 0, (lists->ngbr_cnt + 1) / 2);
+        for (i = 0; i < lists->ngbr_cnt; i++)
+        {
+            p[i / 2] |= lists->ngbrs[i].lq << ((i & 1) ? 0 : 4);
+        }
+    }
+    return success;
+}
+
+
+bool HeyMacCmd::cmd_join(uint8_t const ctl, uint16_t const net_id, uint16_t const net_addr)
+{
+    bool success = false;
+    uint8_t *cmd = _alloc(1 + JOIN_SZ);
+
+    if (cmd)
+    {
+        cmd[CMD_IDX] = CMD_PREFIX | HM_CID_JOIN;
+        cmd[CMD_IDX + 1] = ctl;
+        be16_st(&cmd[CMD_IDX + 2], net_id);
+        be16_st(&cmd[CMD_IDX + 4], net_addr);
+        success = true;
+    }
+    return success;
+}
+
+
+bool HeyMacCmd::cmd_rte(uint16_t const src, hm_rte_adv_t const *rtes, uint8_t const rte_cnt)
+{
+    bool success = false;
+    uint16_t const sz = 1 + RTE_SZ + RTE_ADV_SZ * rte_cnt;
+    uint8_t *cmd = nullptr;
+    uint8_t *p;
+    uint8_t i;
+
+    if (sz <= FRM_SZ_MAX)
+    {
+        cmd = _alloc(sz);
+    }
+    if (cmd)
+    {
+        cmd[CMD_IDX] = CMD_PREFIX | HM_CID_RTE;
+        be16_st(&cmd[CMD_IDX + 1], src);
+        cmd[CMD_IDX + 3] = rte_cnt;
+        p = &cmd[CMD_IDX + 1 + RTE_SZ];
+        for (i = 0; i < rte_cnt; i++)
+        {
+            be16_st(&p[0], rtes[i].dst);
+            be16_st(&p[2], rtes[i].next_hop);
+            p[4] = rtes[i].metric;
+            p += RTE_ADV_SZ;
+        }
+        success = true;
+    }
+    return success;
+}
+
+
+void HeyMacCmd::get_rte(hm_cmd_rte_t const *rte, uint8_t i, hm_rte_adv_t *r_adv)
+{
+    MBED_ASSERT(i < rte->rte_cnt);
+
+    uint8_t const *const p = &rte->rtes[RTE_ADV_SZ * i];
+
+    r_adv->dst = be16_ld(&p[0]);
+    r_adv->next_hop = be16_ld(&p[2]);
+    r_adv->metric = p[4];
+}
+
+
+bool HeyMacCmd::decode(uint8_t const *cmd, uint8_t sz, hm_cmd_t *r_cmd)
+{
+    bool success = false;
+    cmd_dec_t dec;
+
+    if ((sz > CMD_IDX) && ((cmd[CMD_IDX] & CMD_PREFIX_MASK) == CMD_PREFIX))
+    {
+        r_cmd->cid = cmd[CMD_IDX] & CMD_MASK;
+        dec = s_dec_lut[r_cmd->cid];
+        if (dec)
+        {
+            success = dec(&cmd[CMD_IDX + 1], sz - 1, r_cmd);
+        }
+    }
+    return success;
+}
+
+bool HeyMacCmd::find(uint8_t const *payld, uint8_t sz, hm_cid_t8 cid, hm_cmd_t *r_cmd)
+{
+    bool found = false;
+    uint16_t offset;
+    uint8_t rec_sz;
+
+    if ((sz > CMD_IDX) && (payld[CMD_IDX] == (CMD_PREFIX | HM_CID_AGG)))
+    {
+        /* Each record is [rec_sz][command], as HeyMacCmdDispatch walks them */
+        offset = CMD_IDX + 1;
+        while (!found && (offset + AGG_REC_HDR_SZ < sz))
+        {
+            rec_sz = payld[offset];
+            offset += AGG_REC_HDR_SZ;
+            if ((offset + rec_sz > sz)
+             || !decode(&payld[offset], rec_sz, r_cmd))
+            {
+                break;
+            }
+            found = (r_cmd->cid == cid);
+            offset += rec_sz;
+        }
+    }
+    else
+    {
+        found = decode(payld, sz, r_cmd) && (r_cmd->cid == cid);
+    }
+    return found;
+}
+
+
+// PRIVATE
+
+void HeyMacCmd::_put_sbcn(uint8_t *p, hm_cmd_sbcn_t const *sbcn)
+{
+    p[0] = sbcn->dscpln;
+    be16_st(&p[1], sbcn->caps);
+    be16_st(&p[3], sbcn->status);
+    be32_st(&p[5], sbcn->asn);
+}
+
+uint8_t *HeyMacCmd::_alloc(uint8_t cmd_sz)
+{
+    uint8_t *cmd = nullptr;
+    uint8_t *payld = _frm->get_payld();
+    uint8_t payld_sz = _frm->get_payld_sz();
+    uint16_t frm_sz = _frm->get_frm_sz();
+
+    if (_aggregate)
+    {
+        if (frm_sz + AGG_REC_HDR_SZ + cmd_sz <= FRM_SZ_MAX)
+        {
+            payld[payld_sz] = cmd_sz;
+            cmd = &payld[payld_sz + AGG_REC_HDR_SZ];
+            _frm->set_payld_sz(payld_sz + AGG_REC_HDR_SZ + cmd_sz);
+        }
+    }
+
+    /* A single command replaces the existing payload */
+    else if (frm_sz - payld_sz + cmd_sz <= FRM_SZ_MAX)
+    {
+        cmd = payld;
+        _frm->set_payld_sz(cmd_sz);
+    }
+    return cmd;
+}
+
+
+/* Decoders.  cmd and sz exclude the CID octet */
+
+static bool s_dec_sbcn(uint8_t const *cmd, uint8_t sz, hm_cmd_t *r_cmd)
+{
+    bool success = false;
+
+    if (sz >= SBCN_SZ)
+    {
+        r_cmd->sbcn.dscpln = cmd[0];
+        r_cmd->sbcn.caps = be16_ld(&cmd[1]);
+        r_cmd->sbcn.status = be16_ld(&cmd[3]);
+        r_cmd->sbcn.asn = be32_ld(&cmd[5]);
+        success = true;
+    }
+    return success;
+}
+
+static bool s_dec_ebcn(uint8_t const *cmd, uint8_t sz, hm_cmd_t *r_cmd)
+{
+    bool success = false;
 
-    if (offset + 1 + sz <= HM_FRAME_SZ)
+    if ((sz > SBCN_SZ)
+     && s_dec_sbcn(cmd, sz, r_cmd)
+     && (sz >= SBCN_SZ + 1 + 2 * cmd[SBCN_SZ]))
     {
-        payld = _frm->get_frm() + offset;
-        payld[CMD_IDX] = CMD_PREFIX | HM_CID_TXT;
-        memcpy(&payld[CMD_IDX + 1], txt, sz);
-        _frm->set_payld_sz(1 + sz);
+        r_cmd->ebcn.ngbr_cnt = cmd[SBCN_SZ];
+        r_cmd->ebcn.ngbrs = &cmd[SBCN_SZ + 1];
         success = true;
     }
     return success;
 }
 
+static bool s_dec_txt(uint8_t const *cmd, uint8_t sz, hm_cmd_t *r_cmd)
+{
+    r_cmd->txt.txt = (char const *)cmd;
+    r_cmd->txt.sz = sz;
+    return true;
+}
+
+static bool s_dec_cbcn(uint8_t const *cmd, uint8_t sz, hm_cmd_t *r_cmd)
+{
+    bool success = false;
+    hm_cmd_cbcn_t *cbcn = &r_cmd->cbcn;
+    uint16_t offset = CBCN_SZ;
+    uint16_t delta;
+    uint8_t vi_sz;
+    uint8_t n;
+
+    memset(cbcn, 0, sizeof(*cbcn));
+    if (sz >= CBCN_SZ)
+    {
+        cbcn->caps = be16_ld(&cmd[0]);
+        cbcn->status = be16_ld(&cmd[2]);
+
+        /* The lists are optional */
+        success = (sz == CBCN_SZ);
+    }
+
+    if (sz > CBCN_SZ)
+    {
+        cbcn->net_cnt = cmd[offset++];
+        cbcn->nets = &cmd[offset];
+        offset += 2 * cbcn->net_cnt;
+
+        if (offset + 2 <= sz)
+        {
+            cbcn->ngbr_delta = (cmd[offset] & CBCN_NGBR_DELTA) != 0;
+            cbcn->ngbr_seq = cmd[offset] & CBCN_NGBR_SEQ_MASK;
+            cbcn->ngbr_cnt = cmd[offset + 1];
+            cbcn->ngbr_addrs = &cmd[offset + 2];
+            offset += 2;
+
+            /* Walk the varints once so the iterator needs no bounds checks */
+            for (n = 0; n < cbcn->ngbr_cnt; n++)
+            {
+                vi_sz = (offset < sz) ? s_varint_get(&cmd[offset], sz - offset, &delta) : 0;
+                if (vi_sz == 0)
+                {
+                    break;
+                }
+                offset += vi_sz;
+            }
+            cbcn->ngbr_lqs = &cmd[offset];
+            success = (n == cbcn->ngbr_cnt)
+                   && (offset + (cbcn->ngbr_cnt + 1) / 2 <= sz);
+        }
+    }
+    return success;
+}
+
+static bool s_dec_join(uint8_t const *cmd, uint8_t sz, hm_cmd_t *r_cmd)
+{
+    bool success = false;
+
+    if (sz >= JOIN_SZ)
+    {
+        r_cmd->join.ctl = cmd[0];
+        r_cmd->join.net_id = be16_ld(&cmd[1]);
+        r_cmd->join.net_addr = be16_ld(&cmd[3]);
+        success = true;
+    }
+    return success;
+}
 
-bool HeyMacCmd::cmd_cbcn(uint16_t const caps, uint16_t const status)
+static bool s_dec_rte(uint8_t const *cmd, uint8_t sz, hm_cmd_t *r_cmd)
 {
     bool success = false;
-    uint8_t *payld = nullptr;
-    uint16_t offset = _frm->get_frm_sz();
 
-    if (offset + 1 + 4 <= HM_FRAME_SZ)
+    if ((sz >= RTE_SZ) && (sz >= RTE_SZ + RTE_ADV_SZ * cmd[2]))
+    {
+        r_cmd->rte.src = be16_ld(&cmd[0]);
+        r_cmd->rte.rte_cnt = cmd[2];
+        r_cmd->rte.rtes = &cmd[RTE_SZ];
+        success = true;
+    }
+    return success;
+}
+
+
+/* Varints */
+
+static uint8_t s_varint_sz(uint16_t v)
+{
+    uint8_t sz = 1;
+
+    while (v > VARINT_MASK)
     {
-        payld = _frm->get_frm() + offset;
-        payld[CMD_IDX] = CMD_PREFIX | HM_CID_CBCN;
-        payld[CMD_IDX + 1] = caps >> 8;
-        payld[CMD_IDX + 2] = caps & 0xFF;
-        payld[CMD_IDX + 3] = status >> 8;
-        payld[CMD_IDX + 4] = status & 0xFF;
+        v >>= 7;
+        sz++;
+    }
+    return sz;
+}
+
+static uint8_t s_varint_put(uint8_t *p, uint16_t v)
+{
+    uint8_t sz = 0;
 
-        _frm->set_payld_sz(1 + 4);
+    while (v > VARINT_MASK)
+    {
+        p[sz++] = (v & VARINT_MASK) | VARINT_MORE;
+        v >>= 7;
+    }
+    p[sz++] = v;
+    return sz;
+}
+
+/*
+Returns the number of octets used by the varint at p
+and fills r_v with its value.
+Returns 0 if the varint runs past sz or is too long for 16 bits.
+*/
+static uint8_t s_varint_get(uint8_t const *p, uint8_t sz, uint16_t *r_v)
+{
+    uint8_t i = 0;
+    uint8_t used = 0;
+    uint16_t v = 0;
+
+    while ((used == 0) && (i < sz) && (i < VARINT_U16_SZ_MAX))
+    {
+        v |= (uint16_t)(p[i] & VARINT_MASK) << (7 * i);
+        if ((p[i++] & VARINT_MORE) == 0)
+        {
+            used = i;
+        }
+    }
+    *r_v = v;
+    return used;
+}
+
+
+HeyMacCbcnNgbrIter::HeyMacCbcnNgbrIter(hm_cmd_cbcn_t const *cbcn)
+{
+    _cbcn = cbcn;
+    _addrs = cbcn->ngbr_addrs;
+    _addr = 0;
+    _idx = 0;
+}
+
+bool HeyMacCbcnNgbrIter::next(hm_cbcn_ngbr_t *ngbr)
+{
+    bool success = false;
+    uint16_t delta = 0;
+
+    if (_idx < _cbcn->ngbr_cnt)
+    {
+        /* The decoder has checked that the varints are in bounds */
+        _addrs += s_varint_get(_addrs, VARINT_U16_SZ_MAX, &delta);
+        _addr += delta;
+        ngbr->addr = _addr;
+        ngbr->lq = (_cbcn->ngbr_lqs[_idx / 2] >> ((_idx & 1) ? 0 : 4)) & CBCN_LQ_MAX;
+        _idx++;
         success = true;
     }
     return success;
 }
+
+
+HeyMacCmdDispatch::HeyMacCmdDispatch()
+{
+    for (uint8_t i = 0; i < HM_CID_CNT; i++)
+    {
+        _hndlrs[i] = nullptr;
+    }
+}
+
+HeyMacCmdDispatch::~HeyMacCmdDispatch()
+{
+}
+
+
+void HeyMacCmdDispatch::set_hndlr(hm_cid_t8 cid, hndlr_t hndlr)
+{
+    MBED_ASSERT(cid < HM_CID_CNT);
+    _hndlrs[cid] = hndlr;
+}
+
+void HeyMacCmdDispatch::clr_hndlr(hm_cid_t8 cid)
+{
+    MBED_ASSERT(cid < HM_CID_CNT);
+    _hndlrs[cid] = nullptr;
+}
+
+uint8_t HeyMacCmdDispatch::dispatch(uint8_t const *payld, uint8_t sz)
+{
+    uint8_t cnt = 0;
+    uint16_t offset;
+    uint8_t rec_sz;
+
+    if ((sz > CMD_IDX) && (payld[CMD_IDX] == (CMD_PREFIX | HM_CID_AGG)))
+    {
+        /* Each record is [rec_sz][command] */
+        offset = CMD_IDX + 1;
+        while (offset + AGG_REC_HDR_SZ < sz)
+        {
+            rec_sz = payld[offset];
+            offset += AGG_REC_HDR_SZ;
+            if ((offset + rec_sz > sz)
+             || !_dispatch_one(&payld[offset], rec_sz, &cnt))
+            {
+                break;
+            }
+            offset += rec_sz;
+        }
+    }
+    else
+    {
+        _dispatch_one(payld, sz, &cnt);
+    }
+    return cnt;
+}
+
+
+// PRIVATE
+
+bool HeyMacCmdDispatch::_dispatch_one(uint8_t const *cmd, uint8_t sz, uint8_t *r_cnt)
+{
+    bool success;
+    hm_cmd_t dec_cmd;
+
+    success = HeyMacCmd::decode(cmd, sz, &dec_cmd);
+    if (success && _hndlrs[dec_cmd.cid])
+    {
+        _hndlrs[dec_cmd.cid](&dec_cmd);
+        (*r_cnt)++;
+    }
+    return success;
+}
@@ -4,11 +4,160 @@
 #define HEYMACCMD_H_
 
 #include <stdint.h>
+#include "mbed.h"
 #include "HeyMacFrame.h"
 
 
 static int const CMD_SZ_MAX = 256;
 
+/* Command IDs.  The low 6 bits of a command's first octet */
+typedef uint8_t hm_cid_t8;
+enum
+{
+    HM_CID_INVALID = 0,
+    HM_CID_SBCN = 1,
+    HM_CID_EBCN = 2,
+    HM_CID_TXT = 3,
+    HM_CID_CBCN = 4,
+    HM_CID_JOIN = 5,
+    HM_CID_AGG = 6,
+    HM_CID_TXTZ = 7,    /* TXT compressed by HeyMacTxtz */
+    HM_CID_RTE = 8,     /* Route advertisement */
+
+    HM_CID_CNT = 64,
+};
+
+/* Join command control values */
+typedef enum
+{
+    HM_JOIN_RQST = 1,
+    HM_JOIN_ACPT = 2,
+    HM_JOIN_CNFM = 3,
+    HM_JOIN_RJCT = 4,
+    HM_JOIN_LEAVE = 5,
+} hm_join_ctl_t8;
+
+/**
+ * Decoded commands.
+ * Fixed-size fields are decoded by value;
+ * variable-size fields refer into the received payload (no copy)
+ * and are only valid while the frame is.
+ */
+typedef struct
+{
+    uint8_t dscpln;     /* Discipline (a PID value) */
+    uint16_t caps;
+    uint16_t status;
+    uint32_t asn;       /* Absolute slot number */
+} hm_cmd_sbcn_t;
+
+typedef struct
+{
+    hm_cmd_sbcn_t sbcn;
+    uint8_t ngbr_cnt;
+    uint8_t const *ngbrs; /* ngbr_cnt big-endian 16-bit short addresses */
+} hm_cmd_ebcn_t;
+
+/**
+ * Text of a TXT or TXTZ command.
+ * For TXTZ, the text is compressed; read it with a HeyMacTxtzDecoder.
+ */
+typedef struct
+{
+    char const *txt;    /* NOT null-terminated */
+    uint8_t sz;
+} hm_cmd_txt_t;
+
+/**
+ * A CBCN may carry the sender's networks and neighbors after caps and status:
+ *
+ *   [net_cnt] [net_id (be16)]*
+ *   [D|seq] [ngbr_cnt] [addr delta (varint)]* [lq nibbles]
+ *
+ * Neighbors are sorted by ascending short address and each address is
+ * sent as a varint of its difference from the previous one.
+ * The link-quality nibbles (high nibble first) follow the addresses.
+ * If D is set, the list holds only the changes since the beacon with
+ * sequence number seq - 1, and a link quality of 0 means the neighbor
+ * was lost.  A receiver that missed that beacon waits for a full list.
+ */
+typedef struct
+{
+    uint16_t caps;
+    uint16_t status;
+
+    uint8_t net_cnt;
+    uint8_t const *nets;        /* net_cnt big-endian 16-bit net IDs */
+
+    uint8_t ngbr_seq;
+    bool ngbr_delta;
+    uint8_t ngbr_cnt;
+    uint8_t const *ngbr_addrs;  /* Use a HeyMacCbcnNgbrIter to read */
+    uint8_t const *ngbr_lqs;
+} hm_cmd_cbcn_t;
+
+/** One neighbor in a CBCN */
+typedef struct
+{
+    uint16_t addr;
+    uint8_t lq;     /* Link quality 1..15 (0 means lost in a delta list) */
+} hm_cbcn_ngbr_t;
+
+/** The lists to put in a CBCN */
+typedef struct
+{
+    uint16_t const *nets;
+    uint8_t net_cnt;
+    hm_cbcn_ngbr_t const *ngbrs; /* MUST be sorted by ascending addr */
+    uint8_t ngbr_cnt;
+    uint8_t seq;                 /* 7 bits */
+    bool delta;
+} hm_cbcn_lists_t;
+
+typedef struct
+{
+    uint8_t ctl;        /* hm_join_ctl_t8 */
+    uint16_t net_id;
+    uint16_t net_addr;
+} hm_cmd_join_t;
+
+/**
+ * A route advertisement: the sender's short address
+ * and, for each destination it has a route to, its next hop and metric:
+ *
+ *   [src (be16)] [rte_cnt] {[dst (be16)] [next_hop (be16)] [metric]}*
+ *
+ * A receiver that is the next hop ignores the route (split horizon).
+ */
+typedef struct
+{
+    uint16_t src;
+    uint8_t rte_cnt;
+    uint8_t const *rtes;    /* Use HeyMacCmd::get_rte() to read */
+} hm_cmd_rte_t;
+
+/** One route in a route advertisement */
+typedef struct
+{
+    uint16_t dst;
+    uint16_t next_hop;
+    uint8_t metric;
+} hm_rte_adv_t;
+
+typedef struct
+{
+    hm_cid_t8 cid;
+    union
+    {
+        hm_cmd_sbcn_t sbcn;
+        hm_cmd_ebcn_t ebcn;
+        hm_cmd_txt_t txt;   /* TXT and TXTZ */
+        hm_cmd_cbcn_t cbcn;
+        hm_cmd_join_t join;
+        hm_cmd_rte_t rte;
+    };
+} hm_cmd_t;
+
 
 class HeyMacCmd
 {
@@ -18,21 +167,130 @@ public:
 
     /**
      * Keeps the reference to the frame
-     * so it may be used by the cmd_*() methods
+     * so it may be used by the cmd_*() methods.
+     *
+     * If aggregate is false, each cmd_*() replaces the frame's payload.
+     * If aggregate is true, the payload starts with the AGG command
+     * and each cmd_*() appends one record: [rec_sz][command octets].
+     * Records are added until the frame reaches its maximum size.
+     */
+    void cmd_init(HeyMacFrame *frm, bool aggregate = false);
+
+    /**
+     * Sets the Pending bit in the current frame to tell the receiver
+     * to keep listening, then continues with next in the same mode.
+     * The caller enqueues both frames, the current one first.
      */
-    void cmd_init(HeyMacFrame *frm);
+    void cmd_chain(HeyMacFrame *next);
 
     /**
      * Returns true if the command will fit within the frame's payload
      * and fills the frame's payload with the command.
      * Return false if there is no room
      * and leaves the payload unchanged.
+     * cmd_txt() sends a TXTZ instead if compression makes it smaller.
      */
+    bool cmd_sbcn(hm_cmd_sbcn_t const *sbcn);
+    bool cmd_ebcn(hm_cmd_sbcn_t const *sbcn, uint16_t const *ngbrs, uint8_t const ngbr_cnt);
     bool cmd_txt(char const *const txt, uint8_t const sz);
-    bool cmd_cbcn(uint16_t const caps, uint16_t const status); // TODO: nets,ngbrs needs outside data
+    bool cmd_cbcn(uint16_t const caps, uint16_t const status, hm_cbcn_lists_t const *lists = nullptr);
+    bool cmd_join(uint8_t const ctl, uint16_t const net_id, uint16_t const net_addr);
+    bool cmd_rte(uint16_t const src, hm_rte_adv_t const *rtes, uint8_t const rte_cnt);
+
+    /**
+     * Returns true if the single command in cmd (sz octets)
+     * is well-formed and fills r_cmd with its decoded fields.
+     * Never reads beyond sz.  An AGG command is not decoded here;
+     * see HeyMacCmdDispatch.
+     */
+    static bool decode(uint8_t const *cmd, uint8_t sz, hm_cmd_t *r_cmd);
+
+    /**
+     * Returns true if the payload (sz octets) holds a well-formed command
+     * with the given CID, alone or as a record of an AGG,
+     * and fills r_cmd with the first one found.
+     */
+    static bool find(uint8_t const *payld, uint8_t sz, hm_cid_t8 cid, hm_cmd_t *r_cmd);
+
+    /** Fills r_adv with route i (< rte_cnt) of a decoded RTE */
+    static void get_rte(hm_cmd_rte_t const *rte, uint8_t i, hm_rte_adv_t *r_adv);
 
 private:
     HeyMacFrame *_frm;
+    bool _aggregate;
+
+    /**
+     * Returns where a command of cmd_sz octets is to be written
+     * and adds it to the payload's size.
+     * Returns nullptr if the command will not fit.
+     */
+    uint8_t *_alloc(uint8_t cmd_sz);
+
+    /** Writes the fields common to SBCN and EBCN */
+    static void _put_sbcn(uint8_t *p, hm_cmd_sbcn_t const *sbcn);
+};
+
+
+/**
+ * HeyMacCbcnNgbrIter
+ *
+ * Iterates over the neighbors of a decoded CBCN.
+ */
+class HeyMacCbcnNgbrIter
+{
+public:
+    HeyMacCbcnNgbrIter(hm_cmd_cbcn_t const *cbcn);
+
+    /**
+     * Fills ngbr with the next neighbor and returns true.
+     * Returns false after the last neighbor.
+     */
+    bool next(hm_cbcn_ngbr_t *ngbr);
+
+private:
+    hm_cmd_cbcn_t const *_cbcn;
+    uint8_t const *_addrs;
+    uint16_t _addr;
+    uint8_t _idx;
+};
+
+
+/**
+ * HeyMacCmdDispatch
+ *
+ * Routes the commands in a received payload to registered handlers.
+ * The CID selects the decoder and the handler from 64-entry tables,
+ * so there is no switch cascade and the payload is never copied.
+ * The commands in an AGG payload are dispatched in order.
+ * Handlers MUST NOT keep references into the command after they return.
+ */
+class HeyMacCmdDispatch
+{
+public:
+    typedef Callback<void(hm_cmd_t const *cmd)> hndlr_t;
+
+    HeyMacCmdDispatch();
+    ~HeyMacCmdDispatch();
+
+    /** Registers the handler for a CID, replacing any previous one */
+    void set_hndlr(hm_cid_t8 cid, hndlr_t hndlr);
+
+    /** Unregisters the handler for a CID */
+    void clr_hndlr(hm_cid_t8 cid);
+
+    /**
+     * Decodes the command(s) in a received payload
+     * and calls the handler registered for each.
+     * Returns the number of commands handled.
+     * Stops at the first malformed command.
+     */
+    uint8_t dispatch(uint8_t const *payld, uint8_t sz);
+
+private:
+    hndlr_t _hndlrs[HM_CID_CNT];
+
+    /** Returns true if the command was well-formed */
+    bool _dispatch_one(uint8_t const *cmd, uint8_t sz, uint8_t *r_cnt);
 };
 
 #endif /* HEYMACCMD_H_ */
@@ -0,0 +1,109 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mbed.h"
+
+#include "HeyMacCsma.h"
+
+
+/* Defaults.  A slot covers a CAD and the RX/TX turnaround at SF7/BW250 */
+static uint8_t const CSMA_BE_MIN = 2;
+static uint8_t const CSMA_BE_MAX = 5;
+static uint8_t const CSMA_RETRY_MAX = 5;
+static uint16_t const CSMA_SLOT_MS = 10;
+
+/* The PRNG state must never be zero */
+static uint32_t const PRNG_INIT = 0x48654D61; /* "HeMa" */
+
+
+HeyMacCsma::HeyMacCsma()
+{
+    _cfg.be_min = CSMA_BE_MIN;
+    _cfg.be_max = CSMA_BE_MAX;
+    _cfg.retry_max = CSMA_RETRY_MAX;
+    _cfg.slot_ms = CSMA_SLOT_MS;
+    memset(&_stats, 0, sizeof(_stats));
+    _be = _cfg.be_min;
+    _retry_cnt = 0;
+    _prng = PRNG_INIT;
+}
+
+HeyMacCsma::~HeyMacCsma()
+{
+}
+
+
+void HeyMacCsma::set_cfg(hm_csma_cfg_t const *cfg)
+{
+    MBED_ASSERT((cfg->be_min <= cfg->be_max) && (cfg->be_max < 16));
+
+    _cfg = *cfg;
+    _be = _cfg.be_min;
+    _retry_cnt = 0;
+}
+
+void HeyMacCsma::get_cfg(hm_csma_cfg_t *r_cfg)
+{
+    *r_cfg = _cfg;
+}
+
+void HeyMacCsma::seed(uint32_t entropy)
+{
+    _prng ^= entropy;
+    if (_prng == 0)
+    {
+        _prng = PRNG_INIT;
+    }
+}
+
+void HeyMacCsma::chnl_clear(void)
+{
+    _stats.cad_cnt++;
+    _be = _cfg.be_min;
+    _retry_cnt = 0;
+}
+
+bool HeyMacCsma::chnl_busy(uint32_t *r_backoff_ms)
+{
+    bool retry = false;
+
+    _stats.cad_cnt++;
+    _stats.busy_cnt++;
+
+    if (_retry_cnt < _cfg.retry_max)
+    {
+        _retry_cnt++;
+        *r_backoff_ms = (_rand() & ((1UL << _be) - 1)) * _cfg.slot_ms;
+        _stats.backoff_ms += *r_backoff_ms;
+        if (_be < _cfg.be_max)
+        {
+            _be++;
+        }
+        retry = true;
+    }
+    else
+    {
+        _stats.drop_cnt++;
+        _be = _cfg.be_min;
+        _retry_cnt = 0;
+    }
+    return retry;
+}
+
+void HeyMacCsma::get_stats(hm_csma_stats_t *r_stats)
+{
+    *r_stats = _stats;
+}
+
+
+// PRIVATE
+
+uint32_t HeyMacCsma::_rand(void)
+{
+    _prng ^= _prng << 13;
+    _prng ^= _prng >> 17;
+    _prng ^= _prng << 5;
+    return _prng;
+}
@@ -0,0 +1,78 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#ifndef HEYMACCSMA_H_
+#define HEYMACCSMA_H_
+
+/**
+ * HeyMacCsma
+ *
+ * The channel access rules for the CSMA_V0 protocol.
+ * Before each transmission the radio performs Channel Activity Detection.
+ * If the channel is busy, the sender backs off for a random number
+ * of slots in [0, 2^BE - 1], where the backoff exponent BE starts at be_min
+ * and grows by one per busy CAD up to be_max.
+ * After retry_max busy CADs in a row, the frame is dropped.
+ *
+ * This class holds the backoff state, the PRNG and the statistics;
+ * HeyMacLayer drives the radio and the timing.
+ */
+
+#include <stdint.h>
+
+
+/** CSMA configuration */
+typedef struct
+{
+    uint8_t be_min;     /* Initial backoff exponent */
+    uint8_t be_max;     /* Largest backoff exponent */
+    uint8_t retry_max;  /* Busy CADs before the frame is dropped */
+    uint16_t slot_ms;   /* Duration of one backoff slot */
+} hm_csma_cfg_t;
+
+/** CSMA statistics */
+typedef struct
+{
+    uint32_t cad_cnt;       /* CADs performed */
+    uint32_t busy_cnt;      /* CADs that found the channel busy (TX deferred) */
+    uint32_t drop_cnt;      /* frames dropped after retry_max busy CADs */
+    uint32_t backoff_ms;    /* total time spent backing off */
+} hm_csma_stats_t;
+
+
+class HeyMacCsma
+{
+public:
+    HeyMacCsma();
+    ~HeyMacCsma();
+
+    void set_cfg(hm_csma_cfg_t const *cfg);
+    void get_cfg(hm_csma_cfg_t *r_cfg);
+
+    /** Mixes entropy (e.g. the radio's RSSI noise) into the PRNG */
+    void seed(uint32_t entropy);
+
+    /** Call when CAD finds the channel clear; resets the backoff */
+    void chnl_clear(void);
+
+    /**
+     * Call when CAD finds the channel busy.
+     * Returns true and fills r_backoff_ms with the random backoff;
+     * returns false if the retries are used up and the frame should
+     * be dropped (the backoff is reset for the next frame).
+     */
+    bool chnl_busy(uint32_t *r_backoff_ms);
+
+    void get_stats(hm_csma_stats_t *r_stats);
+
+private:
+    hm_csma_cfg_t _cfg;
+    hm_csma_stats_t _stats;
+    uint8_t _be;
+    uint8_t _retry_cnt;
+    uint32_t _prng;
+
+    /** xorshift32 */
+    uint32_t _rand(void);
+};
+
+#endif /* HEYMACCSMA_H_ */
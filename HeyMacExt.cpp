@@ -0,0 +1,90 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mbed.h"
+
+#include "HeyMac.h"
+#include "HeyMacExt.h"
+#include "HeyMacFrame.h"
+
+
+/* The extended type is the first octet after the FCTL */
+static uint8_t const FRM_IDX_EXT_TYPE = FRM_IDX_FCTL + 1;
+
+
+HeyMacExt::HeyMacExt()
+{
+    memset(_type_to_hndlr, NO_HNDLR, sizeof(_type_to_hndlr));
+    for (uint8_t i = 0; i < HM_EXT_HNDLR_CNT; i++)
+    {
+        _hndlrs[i] = nullptr;
+    }
+}
+
+HeyMacExt::~HeyMacExt()
+{
+}
+
+
+bool HeyMacExt::set_hndlr(uint8_t ext_type, hndlr_t hndlr)
+{
+    bool success = false;
+    uint8_t i = _type_to_hndlr[ext_type];
+
+    /* An empty slot is a free slot, so an empty handler cannot be stored */
+    if (!hndlr)
+    {
+        clr_hndlr(ext_type);
+        success = true;
+    }
+
+    /* Reuse this type's slot, or find a free one */
+    else if (i == NO_HNDLR)
+    {
+        for (i = 0; i < HM_EXT_HNDLR_CNT; i++)
+        {
+            if (!_hndlrs[i])
+            {
+                break;
+            }
+        }
+    }
+
+    if (!success && (i < HM_EXT_HNDLR_CNT))
+    {
+        _hndlrs[i] = hndlr;
+        _type_to_hndlr[ext_type] = i;
+        success = true;
+    }
+    return success;
+}
+
+void HeyMacExt::clr_hndlr(uint8_t ext_type)
+{
+    uint8_t const i = _type_to_hndlr[ext_type];
+
+    if (i != NO_HNDLR)
+    {
+        _hndlrs[i] = nullptr;
+        _type_to_hndlr[ext_type] = NO_HNDLR;
+    }
+}
+
+bool HeyMacExt::dispatch(uint8_t const *frm, uint8_t sz)
+{
+    bool handled = false;
+    uint8_t i;
+
+    if ((sz > FRM_IDX_EXT_TYPE) && (frm[FRM_IDX_FCTL] & FCTL_BIT_X))
+    {
+        i = _type_to_hndlr[frm[FRM_IDX_EXT_TYPE]];
+        if (i != NO_HNDLR)
+        {
+            _hndlrs[i](frm, sz);
+            handled = true;
+        }
+    }
+    return handled;
+}
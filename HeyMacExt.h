@@ -0,0 +1,61 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#ifndef HEYMACEXT_H_
+#define HEYMACEXT_H_
+
+/**
+ * HeyMacExt
+ *
+ * A registry of handlers for eXtended frames (FCTL.X is set).
+ * Everything after the FCTL of an eXtended frame is application defined;
+ * the first octet after the FCTL is the extended type
+ * and selects the handler.
+ *
+ * dispatch() is a lookup in a 256-entry table indexed by the extended type,
+ * so eXtended frames skip the generic HeyMac header parsing entirely.
+ * Handlers receive the frame in place (no copy) and MUST NOT keep
+ * the reference after they return.
+ */
+
+#include <stdint.h>
+
+#include "mbed.h"
+
+#include "HeyMac.h"
+
+
+class HeyMacExt
+{
+public:
+    /** Handler type.  Receives the whole frame (starting at the PID) and its size */
+    typedef Callback<void(uint8_t const *frm, uint8_t sz)> hndlr_t;
+
+    HeyMacExt();
+    ~HeyMacExt();
+
+    /**
+     * Registers the handler for an extended type, replacing any previous one.
+     * An empty handler unregisters the type, as clr_hndlr() does.
+     * Returns false if HM_EXT_HNDLR_CNT handlers are already registered.
+     */
+    bool set_hndlr(uint8_t ext_type, hndlr_t hndlr);
+
+    /** Unregisters the handler for an extended type */
+    void clr_hndlr(uint8_t ext_type);
+
+    /**
+     * Returns true if frm is an eXtended frame
+     * and a handler was registered for its type and has been called.
+     */
+    bool dispatch(uint8_t const *frm, uint8_t sz);
+
+private:
+    /** Slot value meaning no handler is registered */
+    static uint8_t const NO_HNDLR = 0xFF;
+
+    /** Extended type to index into _hndlrs[] */
+    uint8_t _type_to_hndlr[256];
+    hndlr_t _hndlrs[HM_EXT_HNDLR_CNT];
+};
+
+#endif /* HEYMACEXT_H_ */
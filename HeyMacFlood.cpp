@@ -0,0 +1,222 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mbed.h"
+
+#include "HeyMac.h"
+#include "HeyMacFlood.h"
+#include "HeyMacFrame.h"
+#include "HeyMacFrameView.h"
+#include "HeyMacIe.h"
+#include "utl_be.h"
+
+
+MBED_STATIC_ASSERT((HM_FLOOD_DUP_CNT & (HM_FLOOD_DUP_CNT - 1)) == 0,
+                   "HM_FLOOD_DUP_CNT must be a power of two");
+MBED_STATIC_ASSERT(2 * HM_FLOOD_DUP_CNT <= 128, "HM_FLOOD_DUP_CNT is too big");
+
+/* Defaults.  Three copies mean most neighbors have heard the frame */
+static uint8_t const FLOOD_K_COPIES = 3;
+static uint16_t const FLOOD_JITTER_MAX_MS = 200;
+
+/* The PRNG state must never be zero */
+static uint32_t const PRNG_INIT = 0x466C6F6F; /* "Floo" */
+
+
+HeyMacFlood::HeyMacFlood()
+{
+    _cfg.k_copies = FLOOD_K_COPIES;
+    _cfg.jitter_max_ms = FLOOD_JITTER_MAX_MS;
+    memset(&_stats, 0, sizeof(_stats));
+    memset(_tbl, 0, sizeof(_tbl));
+    _cnt = 0;
+    _stamp = 0;
+    _prng = PRNG_INIT;
+}
+
+HeyMacFlood::~HeyMacFlood()
+{
+}
+
+
+void HeyMacFlood::set_cfg(hm_flood_cfg_t const *cfg)
+{
+    MBED_ASSERT(cfg->jitter_max_ms > 0);
+
+    _cfg = *cfg;
+}
+
+void HeyMacFlood::get_cfg(hm_flood_cfg_t *r_cfg)
+{
+    *r_cfg = _cfg;
+}
+
+void HeyMacFlood::seed(uint32_t entropy)
+{
+    _prng ^= entropy;
+    if (_prng == 0)
+    {
+        _prng = PRNG_INIT;
+    }
+}
+
+bool HeyMacFlood::get_key(HeyMacFrameView const &view, uint64_t *r_src, bool *r_is_long, uint32_t *r_seq)
+{
+    bool found = false;
+
+    if ((view.get_pid() == HM_PIDFLD_FLOOD)
+     && view.has_src_addr()
+     && view.is_mhop()
+     && HeyMacIe::get_seq(view.get_ies(), view.get_ie_sz(), r_seq))
+    {
+        *r_is_long = view.is_long_addr();
+        *r_src = *r_is_long ? view.get_src_addr_long() : view.get_src_addr_short();
+        found = true;
+    }
+    return found;
+}
+
+uint8_t HeyMacFlood::heard(uint64_t src, bool is_long, uint32_t seq)
+{
+    uint8_t i = _find(src, is_long, seq);
+    uint8_t j;
+    uint8_t oldest;
+
+    if (_tbl[i].used)
+    {
+        if (_tbl[i].copy_cnt < UINT8_MAX)
+        {
+            _tbl[i].copy_cnt++;
+        }
+        _stats.dup_cnt++;
+    }
+    else
+    {
+        /* Forget the oldest pair to make room, then find the slot again */
+        if (_cnt == HM_FLOOD_DUP_CNT)
+        {
+            oldest = TBL_CNT;
+            for (j = 0; j < TBL_CNT; j++)
+            {
+                if (_tbl[j].used
+                 && ((oldest == TBL_CNT) || ((int32_t)(_tbl[j].stamp - _tbl[oldest].stamp) < 0)))
+                {
+                    oldest = j;
+                }
+            }
+            _remove(oldest);
+            _stats.evict_cnt++;
+            i = _find(src, is_long, seq);
+        }
+
+        _tbl[i].src = src;
+        _tbl[i].seq = seq;
+        _tbl[i].is_long = is_long;
+        _tbl[i].stamp = _stamp++;
+        _tbl[i].copy_cnt = 1;
+        _tbl[i].used = true;
+        _cnt++;
+        _stats.first_cnt++;
+    }
+    return _tbl[i].copy_cnt;
+}
+
+bool HeyMacFlood::is_suppressed(HeyMacFrame *frm)
+{
+    bool suppressed = false;
+    HeyMacFrameView view(frm->get_frm(), frm->get_frm_sz());
+    uint64_t src;
+    bool is_long;
+    uint32_t seq;
+    uint8_t i;
+
+    if ((_cfg.k_copies > 0) && view.parse() && get_key(view, &src, &is_long, &seq))
+    {
+        i = _find(src, is_long, seq);
+        if (_tbl[i].used && (_tbl[i].copy_cnt >= _cfg.k_copies))
+        {
+            _stats.suppress_cnt++;
+            suppressed = true;
+        }
+    }
+    return suppressed;
+}
+
+uint32_t HeyMacFlood::relay_jitter_ms(void)
+{
+    _stats.relay_cnt++;
+    return _rand() % _cfg.jitter_max_ms;
+}
+
+void HeyMacFlood::get_stats(hm_flood_stats_t *r_stats)
+{
+    *r_stats = _stats;
+}
+
+
+// PRIVATE
+
+uint8_t HeyMacFlood::_find(uint64_t src, bool is_long, uint32_t seq)
+{
+    uint8_t i = _hash(src, is_long, seq);
+
+    /* The table is never more than half full, so an empty slot ends the run */
+    while (_tbl[i].used
+        && ((_tbl[i].src != src) || (_tbl[i].is_long != is_long) || (_tbl[i].seq != seq)))
+    {
+        i = (i + 1) & (TBL_CNT - 1);
+    }
+    return i;
+}
+
+uint8_t HeyMacFlood::_hash(uint64_t src, bool is_long, uint32_t seq)
+{
+    uint64_t h = src ^ ((uint64_t)seq << 32) ^ seq;
+
+    /* Keep a short and a long src with the same value apart */
+    if (is_long)
+    {
+        h = ~h;
+    }
+
+    /* Fibonacci hashing: the top bits of the product are well mixed */
+    h *= 0x9E3779B97F4A7C15ULL;
+    return (uint8_t)(h >> 56) & (TBL_CNT - 1);
+}
+
+void HeyMacFlood::_remove(uint8_t i)
+{
+    uint8_t j = i;
+    uint8_t home;
+
+    /*
+    Backward-shift deletion: move each later entry of the probe run
+    into the hole unless its home slot lies cyclically in (hole, entry]
+    */
+    for (;;)
+    {
+        j = (j + 1) & (TBL_CNT - 1);
+        if (!_tbl[j].used)
+        {
+            break;
+        }
+        home = _hash(_tbl[j].src, _tbl[j].is_long, _tbl[j].seq);
+        if (((j - home) & (TBL_CNT - 1)) >= ((j - i) & (TBL_CNT - 1)))
+        {
+            _tbl[i] = _tbl[j];
+            i = j;
+        }
+    }
+    _tbl[i].used = false;
+    _cnt--;
+}
+
+uint32_t HeyMacFlood::_rand(void)
+{
+    _prng ^= _prng << 13;
+    _prng ^= _prng >> 17;
+    _prng ^= _prng << 5;
+    return _prng;
+}
@@ -0,0 +1,121 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#ifndef HEYMACFLOOD_H_
+#define HEYMACFLOOD_H_
+
+/**
+ * HeyMacFlood
+ *
+ * The relay rules for the FLOOD protocol.
+ * A flood frame has the FLOOD PID, a SrcAddr, an HM_IE_SEQ sequence number
+ * and the multihop fields; its Hops field is the hop limit.
+ * The first copy of a (SrcAddr, Seq) pair is given to the upper layer
+ * and, if hops remain, relayed after a random jitter.
+ * Later copies are dropped.  If k copies are heard before the relay
+ * goes out, the relay is suppressed: the neighbors have covered it.
+ *
+ * The pairs are remembered in a fixed-size open-addressing hash set
+ * (linear probing, half full at most) that forgets the oldest pair
+ * when HM_FLOOD_DUP_CNT are held.
+ *
+ * This class holds the cache, the PRNG and the statistics;
+ * HeyMacLayer parses, relays and drops the frames.
+ */
+
+#include <stdint.h>
+
+#include "HeyMac.h"
+#include "HeyMacFrame.h"
+
+class HeyMacFrameView;
+
+
+/** Flood configuration */
+typedef struct
+{
+    uint8_t k_copies;       /* copies heard that suppress a relay (0 never suppresses) */
+    uint16_t jitter_max_ms; /* relays wait a random time in [0, jitter_max_ms) */
+} hm_flood_cfg_t;
+
+/** Flood statistics */
+typedef struct
+{
+    uint32_t first_cnt;     /* first copies received */
+    uint32_t dup_cnt;       /* later copies dropped */
+    uint32_t relay_cnt;     /* relays scheduled */
+    uint32_t suppress_cnt;  /* relays dropped because k copies were heard */
+    uint32_t evict_cnt;     /* pairs forgotten to make room */
+} hm_flood_stats_t;
+
+
+class HeyMacFlood
+{
+public:
+    HeyMacFlood();
+    ~HeyMacFlood();
+
+    void set_cfg(hm_flood_cfg_t const *cfg);
+    void get_cfg(hm_flood_cfg_t *r_cfg);
+
+    /** Mixes entropy (e.g. the radio's RSSI noise) into the PRNG */
+    void seed(uint32_t entropy);
+
+    /**
+     * Returns true and fills r_src, r_is_long and r_seq if the parsed view
+     * is of a flood frame with a SrcAddr and a sequence number.
+     * A short SrcAddr is returned in the low 16 bits.
+     */
+    static bool get_key(HeyMacFrameView const &view, uint64_t *r_src, bool *r_is_long, uint32_t *r_seq);
+
+    /**
+     * Records a received copy of (src, seq).
+     * A short and a long src with the same value are different sources.
+     * Returns the number of copies heard, 1 for the first.
+     */
+    uint8_t heard(uint64_t src, bool is_long, uint32_t seq);
+
+    /**
+     * Returns true if the relay of the given frame should not be sent
+     * because k copies have been heard (and counts the suppression)
+     */
+    bool is_suppressed(HeyMacFrame *frm);
+
+    /** Returns a random relay delay and counts the relay */
+    uint32_t relay_jitter_ms(void);
+
+    void get_stats(hm_flood_stats_t *r_stats);
+
+private:
+    static uint8_t const TBL_CNT = 2 * HM_FLOOD_DUP_CNT;
+
+    typedef struct
+    {
+        uint64_t src;
+        uint32_t seq;
+        bool is_long;       /* src is a long address */
+        uint32_t stamp;     /* insertion order, to find the oldest */
+        uint8_t copy_cnt;
+        bool used;
+    } entry_t;
+
+    hm_flood_cfg_t _cfg;
+    hm_flood_stats_t _stats;
+    entry_t _tbl[TBL_CNT];
+    uint8_t _cnt;
+    uint32_t _stamp;
+    uint32_t _prng;
+
+    /** Returns the index of (src, seq), or of the empty slot it would go in */
+    uint8_t _find(uint64_t src, bool is_long, uint32_t seq);
+
+    /** Returns the home slot of (src, seq) */
+    static uint8_t _hash(uint64_t src, bool is_long, uint32_t seq);
+
+    /** Empties slot i and moves later entries of its probe run back */
+    void _remove(uint8_t i);
+
+    /** xorshift32 */
+    uint32_t _rand(void);
+};
+
+#endif /* HEYMACFLOOD_H_ */
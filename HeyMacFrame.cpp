@@ -2,49 +2,20 @@
 
 #include <string.h>
 
-#include "MemoryPool.h"
-
 #include "HeyMac.h"
 #include "HeyMacFrame.h"
+#include "HeyMacFrameView.h"
+#include "HeyMacIe.h"
+#include "HeyMacMic.h"
+#include "utl_be.h"
 
 
-/* Only the first three fields have a fixed position */
-enum
-{
-    FRM_IDX_PID = 0,
-    FRM_IDX_FCTL = 1,
-    FRM_IDX_NETID = 2,
-};
-
-enum
-{
-    FCTL_BIT_P = 1 << 0,    /* Pending frame follows */
-    FCTL_BIT_M = 1 << 1,    /* Multihop (Hops and TxAddr fields present) */
-    FCTL_BIT_S = 1 << 2,    /* SrcAddr present */
-    FCTL_BIT_I = 1 << 3,    /* IEs present */
-    FCTL_BIT_D = 1 << 4,    /* DstAddr present */
-    FCTL_BIT_N = 1 << 5,    /* NetId present */
-    FCTL_BIT_L = 1 << 6,    /* Long Addressing */
-    FCTL_BIT_X = 1 << 7,    /* Extended frame */
-};
-
 /**
  * We reserve one byte at the start of the buffer for the SPI command
  * and start the radio frame after that.
  */
 static uint8_t const s_frame_start = 1;
 
-/** A static pool of buffers for radio frames */
-static rtos::MemoryPool<uint8_t, HM_FRAME_SZ * HM_FRMBUF_POOL_CNT> s_frmbuf_pool;
-
-
-HeyMacFrame::HeyMacFrame()
-    :
-    /* Call the other constructor with memory from the pool */
-    HeyMacFrame(s_frmbuf_pool.alloc(), 0)
-{
-}
-
 HeyMacFrame::HeyMacFrame(uint8_t * buf, uint8_t sz)
 {
     MBED_ASSERT(buf != nullptr);
@@ -57,16 +28,16 @@ HeyMacFrame::HeyMacFrame(uint8_t * buf, uint8_t sz)
         _frm[FRM_IDX_PID] = HM_PIDFLD_INVALID;
         _frm[FRM_IDX_FCTL] = 0;
         }
-    _payld_offset = 0;
+    _ie_sz = 0;
     _payld_sz = 0;
     _mic_sz = 0;
     _rxd_sz = sz;
+    _updt_offsets(FLD_NETID);
 }
 
 
 HeyMacFrame::~HeyMacFrame()
 {
-    s_frmbuf_pool.free(_buf);
 }
 
 
@@ -82,7 +53,7 @@ uint16_t HeyMacFrame::get_buf_sz(void)
 
 uint8_t *HeyMacFrame::get_frm(void)
 {
-    return &_frm[s_frame_start];
+    return _frm;
 }
 
 uint16_t HeyMacFrame::get_frm_sz(void)
@@ -100,11 +71,38 @@ uint16_t HeyMacFrame::get_frm_sz(void)
         {
             mhop_sz = (_frm[FRM_IDX_FCTL] & FCTL_BIT_L) ? 1 + 8 : 1 + 2;
         }
-        sz = _payld_offset + _payld_sz + _mic_sz + mhop_sz;
+        sz = _fld_offset[FLD_MHOP] + mhop_sz;
     }
     return sz;
 }
 
+uint8_t *HeyMacFrame::get_payld(void)
+{
+    return &_frm[_fld_offset[FLD_PAYLD]];
+}
+
+uint8_t HeyMacFrame::get_payld_sz(void)
+{
+    return _payld_sz;
+}
+
+void HeyMacFrame::set_pending(bool pending)
+{
+    if (pending)
+    {
+        _frm[FRM_IDX_FCTL] |= FCTL_BIT_P;
+    }
+    else
+    {
+        _frm[FRM_IDX_FCTL] &= ~FCTL_BIT_P;
+    }
+}
+
+bool HeyMacFrame::is_pending(void)
+{
+    return (_frm[FRM_IDX_FCTL] & FCTL_BIT_P) != 0;
+}
+
 void HeyMacFrame::set_protocol(hm_pidfld_t8 pidfld)
 {
     _frm[FRM_IDX_PID] = pidfld;
@@ -112,139 +110,107 @@ void HeyMacFrame::set_protocol(hm_pidfld_t8 pidfld)
 
 void HeyMacFrame::set_net_id(uint16_t net_id)
 {
-    /* MSB first (big endian) */
-    _frm[FRM_IDX_NETID] = net_id >> 8;
-    _frm[FRM_IDX_NETID + 1] = net_id & 0xFF;
+    be16_st(&_frm[FRM_IDX_NETID], net_id);
 
     _frm[FRM_IDX_FCTL] |= FCTL_BIT_N;
+    _updt_offsets(FLD_DST);
 }
 
 void HeyMacFrame::set_dst_addr(uint16_t dst_addr)
 {
-    /* Calc the offset of where to put the dst_addr */
-    uint8_t offset = FRM_IDX_NETID;
-    if (_frm[FRM_IDX_FCTL] & FCTL_BIT_N)
-        offset += 2;
+    uint8_t const offset = _fld_offset[FLD_DST];
 
-    /* MSB first (big endian) */
-    _frm[offset + 0] = (dst_addr >> 8) & 0xFF;
-    _frm[offset + 1] = (dst_addr >> 0) & 0xFF;
+    be16_st(&_frm[offset], dst_addr);
 
     _frm[FRM_IDX_FCTL] |= FCTL_BIT_D;
     _frm[FRM_IDX_FCTL] &= ~FCTL_BIT_L;
+    _updt_offsets(FLD_IE);
 }
 
 void HeyMacFrame::set_dst_addr(uint64_t dst_addr)
 {
-    /* Calc the offset of where to put the dst_addr */
-    uint8_t offset = FRM_IDX_NETID;
-    if (_frm[FRM_IDX_FCTL] & FCTL_BIT_N)
-    {
-        offset += 2;
-    }
+    uint8_t const offset = _fld_offset[FLD_DST];
 
-    /* MSB first (big endian) */
-    _frm[offset + 0] = (dst_addr >> 56) & 0xFF;
-    _frm[offset + 1] = (dst_addr >> 48) & 0xFF;
-    _frm[offset + 2] = (dst_addr >> 40) & 0xFF;
-    _frm[offset + 3] = (dst_addr >> 32) & 0xFF;
-    _frm[offset + 4] = (dst_addr >> 24) & 0xFF;
-    _frm[offset + 5] = (dst_addr >> 16) & 0xFF;
-    _frm[offset + 6] = (dst_addr >>  8) & 0xFF;
-    _frm[offset + 7] = (dst_addr >>  0) & 0xFF;
+    be64_st(&_frm[offset], dst_addr);
 
     _frm[FRM_IDX_FCTL] |= FCTL_BIT_D;
     _frm[FRM_IDX_FCTL] |= FCTL_BIT_L;
+    _updt_offsets(FLD_IE);
 }
 
-void HeyMacFrame::set_src_addr(uint16_t src_addr)
+/*
+Returns true if the IE was appended to the frame's IEs list.
+Returns false if there is no room in the buffer for the IE.
+The IEs list is kept terminated after every call.
+*/
+bool HeyMacFrame::add_ie(uint8_t type, uint8_t const *data, uint8_t sz)
 {
-//    assert((_frm[FRM_IDX_FCTL] & FCTL_BIT_L) == 0);
+    bool success = false;
+    uint8_t offset;
+    uint8_t wr_sz;
 
-    /* Calc the offset of where to put the src_addr */
-    uint8_t offset = FRM_IDX_NETID;
-    if (_frm[FRM_IDX_FCTL] & FCTL_BIT_N)
-    {
-        offset += 2;
-    }
-    if (_frm[FRM_IDX_FCTL] & FCTL_BIT_D)
+    /* Write over the terminator of the list, if there is one */
+    offset = _fld_offset[FLD_IE];
+    if (_ie_sz > 0)
     {
-        // TODO: shouldn't support Long addr here since this method sets the Short addr
-        offset += (_frm[FRM_IDX_FCTL] & FCTL_BIT_L) ? 8 : 2;
+        offset += _ie_sz - 1;
     }
-    if (_frm[FRM_IDX_FCTL] & FCTL_BIT_I)
+
+    /* Leave room for the terminator */
+    wr_sz = HeyMacIe::write(&_frm[offset], (HM_FRAME_SZ - s_frame_start - 1) - offset, type, data, sz);
+    if (wr_sz > 0)
     {
-        offset += _get_ie_sz(offset);
+        _frm[offset + wr_sz] = HM_IE_TERM;
+        _ie_sz = (offset + wr_sz + 1) - _fld_offset[FLD_IE];
+        if (HeyMacIe::get_mic_sz(type) > 0)
+        {
+            _mic_sz = HeyMacIe::get_mic_sz(type);
+        }
+
+        _frm[FRM_IDX_FCTL] |= FCTL_BIT_I;
+        _updt_offsets(FLD_SRC);
+        success = true;
     }
+    return success;
+}
 
-    /* MSB first (big endian) */
-    _frm[offset + 0] = (src_addr >> 8) & 0xFF;
-    _frm[offset + 1] = (src_addr >> 0) & 0xFF;
+void HeyMacFrame::set_src_addr(uint16_t src_addr)
+{
+//    assert((_frm[FRM_IDX_FCTL] & FCTL_BIT_L) == 0);
+
+    // TODO: shouldn't support Long dst addr here since this method sets the Short addr
+    uint8_t const offset = _fld_offset[FLD_SRC];
+
+    be16_st(&_frm[offset], src_addr);
 
     _frm[FRM_IDX_FCTL] |= FCTL_BIT_S;
     _frm[FRM_IDX_FCTL] &= ~FCTL_BIT_L;
+    _updt_offsets(FLD_PAYLD);
 }
 
 void HeyMacFrame::set_src_addr(uint64_t src_addr)
 {
 //    assert((_frm[FRM_IDX_FCTL] & FCTL_BIT_L) != 0);
 
-    /* Calc the offset of where to put the src_addr */
-    uint8_t offset = FRM_IDX_NETID;
-    if (_frm[FRM_IDX_FCTL] & FCTL_BIT_N)
-    {
-        offset += 2;
-    }
-    if (_frm[FRM_IDX_FCTL] & FCTL_BIT_D)
-    {
-        offset += (_frm[FRM_IDX_FCTL] & FCTL_BIT_L) ? 8 : 2;
-    }
-    if (_frm[FRM_IDX_FCTL] & FCTL_BIT_I)
-    {
-        offset += _get_ie_sz(offset);
-    }
+    uint8_t const offset = _fld_offset[FLD_SRC];
 
-    /* MSB first (big endian) */
-    _frm[offset + 0] = (src_addr >> 56) & 0xFF;
-    _frm[offset + 1] = (src_addr >> 48) & 0xFF;
-    _frm[offset + 2] = (src_addr >> 40) & 0xFF;
-    _frm[offset + 3] = (src_addr >> 32) & 0xFF;
-    _frm[offset + 4] = (src_addr >> 24) & 0xFF;
-    _frm[offset + 5] = (src_addr >> 16) & 0xFF;
-    _frm[offset + 6] = (src_addr >>  8) & 0xFF;
-    _frm[offset + 7] = (src_addr >>  0) & 0xFF;
+    be64_st(&_frm[offset], src_addr);
 
     _frm[FRM_IDX_FCTL] |= FCTL_BIT_S;
     _frm[FRM_IDX_FCTL] |= FCTL_BIT_L;
+    _updt_offsets(FLD_PAYLD);
 }
 
 bool HeyMacFrame::set_payld(uint8_t * payld, uint8_t sz)
 {
     bool success = false;
-    uint8_t offset = FRM_IDX_NETID;
-
-    if (_frm[FRM_IDX_FCTL] & FCTL_BIT_N)
-    {
-        offset += 2;
-    }
-    if (_frm[FRM_IDX_FCTL] & FCTL_BIT_D)
-    {
-        offset += (_frm[FRM_IDX_FCTL] & FCTL_BIT_L) ? 8 : 2;
-    }
-    if (_frm[FRM_IDX_FCTL] & FCTL_BIT_I)
-    {
-        offset += _get_ie_sz(offset);
-    }
-    if (_frm[FRM_IDX_FCTL] & FCTL_BIT_S)
-    {
-        offset += (_frm[FRM_IDX_FCTL] & FCTL_BIT_L) ? 8 : 2;
-    }
+    uint8_t const offset = _fld_offset[FLD_PAYLD];
 
     if ((offset + sz) < HM_FRAME_SZ)
     {
         memcpy(&_frm[offset], payld, sz);
-        _payld_offset = offset;
         _payld_sz = sz;
+        _updt_offsets(FLD_MIC);
         success = true;
     }
 
@@ -254,11 +220,28 @@ bool HeyMacFrame::set_payld(uint8_t * payld, uint8_t sz)
 void HeyMacFrame::set_payld_sz(uint8_t sz)
 {
     _payld_sz = sz;
+    _updt_offsets(FLD_MIC);
 }
 
-// TODO: set_mic()
-// MIC requires setting an IE field
-// NOTE: MIC is distinct from LoRa's CRC
+/*
+Returns true if the MIC was computed and written after the payload.
+Returns false if the frame has no MIC IE or SrcAddr
+or the key for the SrcAddr is not in the mic's cache.
+Call this last, after set_mhop() if the frame is multihop,
+because the MIC covers the FCTL bits.
+NOTE: MIC is distinct from LoRa's CRC
+*/
+bool HeyMacFrame::set_mic(HeyMacMic &mic)
+{
+    bool success = false;
+
+    if (_mic_sz > 0)
+    {
+        HeyMacFrameView view(_frm, get_frm_sz());
+        success = view.parse() && mic.sign(view, &_frm[_fld_offset[FLD_MIC]]);
+    }
+    return success;
+}
 
 /*
 Returns true if there is room in the buffer for multihop fields
@@ -279,15 +262,13 @@ bool HeyMacFrame::set_mhop(uint8_t hops, uint16_t tx_addr)
     {
         /* Check for available space */
         mhop_sz = (_frm[FRM_IDX_FCTL] & FCTL_BIT_L) ? 1 + 8 : 1 + 2;
-        if ((_payld_offset + _payld_sz + _mic_sz + mhop_sz) <= HM_FRAME_SZ)
+        offset = _fld_offset[FLD_MHOP];
+        if ((offset + mhop_sz) <= HM_FRAME_SZ)
         {
             /* Append Hops, TxAddr fields */
-            offset = _payld_offset + _payld_sz + _mic_sz;
             _frm[offset + 0] = hops;
 
-            /* MSB first (big endian) */
-            _frm[offset + 1] = (tx_addr >> 8) & 0xFF;
-            _frm[offset + 2] = (tx_addr >> 0) & 0xFF;
+            be16_st(&_frm[offset + 1], tx_addr);
 
             _frm[FRM_IDX_FCTL] |= FCTL_BIT_M;
             success = true;
@@ -317,21 +298,13 @@ bool HeyMacFrame::set_mhop(uint8_t hops, uint64_t tx_addr)
     {
         /* Check for available space */
         mhop_sz = (_frm[FRM_IDX_FCTL] & FCTL_BIT_L) ? 1 + 8 : 1 + 2;
-        if ((_payld_offset + _payld_sz + _mic_sz + mhop_sz) <= HM_FRAME_SZ)
+        offset = _fld_offset[FLD_MHOP];
+        if ((offset + mhop_sz) <= HM_FRAME_SZ)
         {
             /* Append Hops, TxAddr fields */
-            offset = _payld_offset + _payld_sz + _mic_sz;
             _frm[offset + 0] = hops;
 
-            /* MSB first (big endian) */
-            _frm[offset + 1] = (tx_addr >> 56) & 0xFF;
-            _frm[offset + 2] = (tx_addr >> 48) & 0xFF;
-            _frm[offset + 3] = (tx_addr >> 40) & 0xFF;
-            _frm[offset + 4] = (tx_addr >> 32) & 0xFF;
-            _frm[offset + 5] = (tx_addr >> 24) & 0xFF;
-            _frm[offset + 6] = (tx_addr >> 16) & 0xFF;
-            _frm[offset + 7] = (tx_addr >>  8) & 0xFF;
-            _frm[offset + 8] = (tx_addr >>  0) & 0xFF;
+            be64_st(&_frm[offset + 1], tx_addr);
 
             _frm[FRM_IDX_FCTL] |= FCTL_BIT_M;
             success = true;
@@ -348,91 +321,119 @@ with received data.
 */
 bool HeyMacFrame::parse(void)
 {
-    bool success = false;
-    uint8_t offset = FRM_IDX_NETID;
+    HeyMacFrameView view(_frm, _rxd_sz);
 
-    if (_frm[FRM_IDX_FCTL] & FCTL_BIT_N)
-        offset += 2;
-    if (_frm[FRM_IDX_FCTL] & FCTL_BIT_D)
-    {
-        offset += (_frm[FRM_IDX_FCTL] & FCTL_BIT_L) ? 8 : 2;
-    }
-    if (_frm[FRM_IDX_FCTL] & FCTL_BIT_I)
-    {
-        offset += _get_ie_sz(offset);
-        _mic_sz = _get_mic_sz(offset);
-    }
-    if (_frm[FRM_IDX_FCTL] & FCTL_BIT_S)
+    return parse(&view);
+}
+
+bool HeyMacFrame::parse(HeyMacFrameView *r_view)
+{
+    bool success;
+
+    MBED_ASSERT(r_view->get_frm() == _frm);
+    success = r_view->parse();
+    if (success)
     {
-        offset += (_frm[FRM_IDX_FCTL] & FCTL_BIT_L) ? 8 : 2;
+        /* Take the field sizes found by the view and cache the offsets */
+        _ie_sz = r_view->get_ie_sz();
+        _payld_sz = r_view->get_payld_sz();
+        _mic_sz = r_view->get_mic_sz();
+        _updt_offsets(FLD_NETID);
     }
+    return success;
+}
 
-    if (offset < _rxd_sz)
-    {
-        uint8_t mhop_sz = 0;
-        int16_t payld_sz;
+/*
+Returns true if the frame's Hops field was decremented
+and its TxAddr overwritten with the given address.
+Returns false if the frame is not multihop
+or it has no hops remaining
+or long addressing is in use (this overload is for short addrs)
+*/
+bool HeyMacFrame::updt_mhop(uint16_t tx_addr)
+{
+    uint8_t const offset = _fld_offset[FLD_MHOP];
+    bool success = false;
 
-        if (_frm[FRM_IDX_FCTL] & FCTL_BIT_M)
-        {
-            mhop_sz = (_frm[FRM_IDX_FCTL] & FCTL_BIT_L) ? 1 + 8 : 1 + 2;
-        }
+    if (((_frm[FRM_IDX_FCTL] & FCTL_BIT_M) != 0)
+     &&((_frm[FRM_IDX_FCTL] & FCTL_BIT_L) == 0)
+     &&(_frm[offset] > 0))
+    {
+        _frm[offset + 0]--;
 
-        _payld_offset = offset;
-        payld_sz = (_rxd_sz - mhop_sz - _mic_sz) - _payld_offset;
-        if (payld_sz > 0)
-        {
-            _payld_sz = payld_sz;
-            success = _validate_fields();
-        }
+        be16_st(&_frm[offset + 1], tx_addr);
+        success = true;
     }
     return success;
 }
 
-
-// PRIVATE
-
-/* Returns the size of all of the IEs */
-uint8_t HeyMacFrame::_get_ie_sz(uint8_t ie_offset)
+/*
+Returns true if the frame's Hops field was decremented
+and its TxAddr overwritten with the given address.
+Returns false if the frame is not multihop
+or it has no hops remaining
+or short addressing is in use (this overload is for long addrs)
+*/
+bool HeyMacFrame::updt_mhop(uint64_t tx_addr)
 {
-    uint8_t ie_sz = 0;
+    uint8_t const offset = _fld_offset[FLD_MHOP];
+    bool success = false;
 
-    // TODO: implement
+    if (((_frm[FRM_IDX_FCTL] & FCTL_BIT_M) != 0)
+     &&((_frm[FRM_IDX_FCTL] & FCTL_BIT_L) != 0)
+     &&(_frm[offset] > 0))
+    {
+        _frm[offset + 0]--;
 
-    return ie_sz;
+        be64_st(&_frm[offset + 1], tx_addr);
+        success = true;
+    }
+    return success;
 }
 
-/* Returns the size of the MIC as determined from an IE */
-uint8_t HeyMacFrame::_get_mic_sz(uint8_t ie_offset)
+bool HeyMacFrame::verify_mic(HeyMacMic &mic)
 {
-    uint8_t mic_sz = 0;
-
-    // TODO: implement
+    HeyMacFrameView view(_frm, _rxd_sz);
 
-    return mic_sz;
+    return view.parse() && mic.verify(view);
 }
 
-/*
-Returns true if no fields are invalid.
-Assumes the _frm contents' size has been validated by caller
-*/
-bool HeyMacFrame::_validate_fields(void)
-{
-    bool success = true;
 
-    /* Only CSMA_V0 is supported at this time */
-    success = success && (_frm[FRM_IDX_PID] == HM_PIDFLD_CSMA_V0);
+// PRIVATE
+
+void HeyMacFrame::_updt_offsets(fld_t const fld)
+{
+    uint8_t const fctl = _frm[FRM_IDX_FCTL];
+    uint8_t const addr_sz = (fctl & FCTL_BIT_L) ? 8 : 2;
 
     /*
-    Any eXtended frame is valid because remaining contents are undefined
-    now check non-eXtended frames
+    Each field's offset is the previous field's offset plus its size.
+    Start at the given field and cascade through the rest.
     */
-    if ((_frm[FRM_IDX_FCTL] & FCTL_BIT_X) == 0)
+    switch (fld)
     {
-        // TODO: validate NetId
-        // TODO: validate DstAddr (HONR)
-        // TODO: validate IEs
-        // TODO: validate SrcAddr (HONR)
-        // TODO: validate Payld has MAC or APv6 header
+        case FLD_NETID:
+            _fld_offset[FLD_NETID] = FRM_IDX_NETID;
+            /* FALLTHROUGH */
+        case FLD_DST:
+            _fld_offset[FLD_DST] = _fld_offset[FLD_NETID] + ((fctl & FCTL_BIT_N) ? 2 : 0);
+            /* FALLTHROUGH */
+        case FLD_IE:
+            _fld_offset[FLD_IE] = _fld_offset[FLD_DST] + ((fctl & FCTL_BIT_D) ? addr_sz : 0);
+            /* FALLTHROUGH */
+        case FLD_SRC:
+            _fld_offset[FLD_SRC] = _fld_offset[FLD_IE] + ((fctl & FCTL_BIT_I) ? _ie_sz : 0);
+            /* FALLTHROUGH */
+        case FLD_PAYLD:
+            _fld_offset[FLD_PAYLD] = _fld_offset[FLD_SRC] + ((fctl & FCTL_BIT_S) ? addr_sz : 0);
+            /* FALLTHROUGH */
+        case FLD_MIC:
+            _fld_offset[FLD_MIC] = _fld_offset[FLD_PAYLD] + _payld_sz;
+            /* FALLTHROUGH */
+        case FLD_MHOP:
+            _fld_offset[FLD_MHOP] = _fld_offset[FLD_MIC] + _mic_sz;
+            /* FALLTHROUGH */
+        default:
+            break;
     }
-    return success;
 }
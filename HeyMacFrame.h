@@ -9,30 +9,128 @@ https://github.com/dwhall/HeyMac/blob/master/docs/HeyMacProtocol.md
 #define HEYMACFRAME_H_
 
 #include <stdint.h>
+#include <type_traits>
 
 #include "HeyMac.h"
+#include "utl_be.h"
+
+class HeyMacFrameView;
+class HeyMacMic;
 
 
 /* Protocol ID (PID) Field */
 typedef enum
 {
     HM_PIDFLD_INVALID = 0,
-    // TODO: HM_PIDFLD_TDMA_V0 = 0xE0,
+    HM_PIDFLD_TDMA_V0 = 0xE0,
     HM_PIDFLD_CSMA_V0 = 0xE4,
-    // TODO: HM_PIDFLD_FLOOD = 0xE8,
+    HM_PIDFLD_FLOOD = 0xE8,
 } hm_pidfld_t8;
 
+/* Only the first three fields have a fixed position */
+enum
+{
+    FRM_IDX_PID = 0,
+    FRM_IDX_FCTL = 1,
+    FRM_IDX_NETID = 2,
+};
+
+/* Frame Control (FCTL) Field bits */
+enum
+{
+    FCTL_BIT_P = 1 << 0,    /* Pending frame follows */
+    FCTL_BIT_M = 1 << 1,    /* Multihop (Hops and TxAddr fields present) */
+    FCTL_BIT_S = 1 << 2,    /* SrcAddr present */
+    FCTL_BIT_I = 1 << 3,    /* IEs present */
+    FCTL_BIT_D = 1 << 4,    /* DstAddr present */
+    FCTL_BIT_N = 1 << 5,    /* NetId present */
+    FCTL_BIT_L = 1 << 6,    /* Long Addressing */
+    FCTL_BIT_X = 1 << 7,    /* Extended frame */
+};
+
+/* Broadcast destination addresses */
+static uint16_t const HM_ADDR_SHORT_BCAST = 0xFFFF;
+static uint64_t const HM_ADDR_LONG_BCAST = UINT64_MAX;
+
+
+/**
+ * HeyMacHdr
+ *
+ * A frame header whose shape (PID and FCTL bits) is fixed at compile time.
+ * Every field offset and the header size are constants,
+ * so writing the header is a few straight-line stores.
+ * IEs, multihop and extended frames have a variable shape
+ * and must be built with the HeyMacFrame setters instead.
+ */
+template <hm_pidfld_t8 PID, uint8_t FCTL>
+struct HeyMacHdr
+{
+    static_assert((FCTL & (FCTL_BIT_I | FCTL_BIT_M | FCTL_BIT_X)) == 0,
+                  "HeyMacHdr: FCTL must not have a variable-size shape");
+
+    /** The address type is given by the FCTL.L bit */
+    typedef typename std::conditional<(FCTL & FCTL_BIT_L) != 0, uint64_t, uint16_t>::type addr_t;
+
+    static constexpr uint8_t ADDR_SZ = sizeof(addr_t);
+    static constexpr uint8_t DST_OFFSET = FRM_IDX_NETID + ((FCTL & FCTL_BIT_N) ? 2 : 0);
+    static constexpr uint8_t SRC_OFFSET = DST_OFFSET + ((FCTL & FCTL_BIT_D) ? ADDR_SZ : 0);
+    static constexpr uint8_t PAYLD_OFFSET = SRC_OFFSET + ((FCTL & FCTL_BIT_S) ? ADDR_SZ : 0);
+    static constexpr uint8_t SZ = PAYLD_OFFSET;
+
+    /**
+     * Writes the header to the start of frm.
+     * Arguments for fields the FCTL does not include are ignored.
+     */
+    static inline void write(uint8_t *frm, addr_t src_addr, addr_t dst_addr = 0, uint16_t net_id = 0)
+    {
+        frm[FRM_IDX_PID] = PID;
+        frm[FRM_IDX_FCTL] = FCTL;
+        if (FCTL & FCTL_BIT_N)
+        {
+            be16_st(&frm[FRM_IDX_NETID], net_id);
+        }
+        if (FCTL & FCTL_BIT_D)
+        {
+            _put_addr(&frm[DST_OFFSET], dst_addr);
+        }
+        if (FCTL & FCTL_BIT_S)
+        {
+            _put_addr(&frm[SRC_OFFSET], src_addr);
+        }
+    }
+
+private:
+    static inline void _put_addr(uint8_t *dst, addr_t addr)
+    {
+        if (ADDR_SZ == 8)
+        {
+            be64_st(dst, addr);
+        }
+        else
+        {
+            be16_st(dst, addr);
+        }
+    }
+};
+
+/** CSMA_V0 with a long SrcAddr: the shape of beacons and text frames */
+typedef HeyMacHdr<HM_PIDFLD_CSMA_V0, FCTL_BIT_L | FCTL_BIT_S> HeyMacHdrCsmaLongSrc;
+
+/** TDMA_V0 with a long SrcAddr: the shape of the TDMA beacon */
+typedef HeyMacHdr<HM_PIDFLD_TDMA_V0, FCTL_BIT_L | FCTL_BIT_S> HeyMacHdrTdmaLongSrc;
+
 
 class HeyMacFrame
 {
 public:
-    /* Init with a newly alloc'd frame */
-    HeyMacFrame();
-
-    /* Init with a received frame */
+    /**
+     * Init over the given buffer, which the frame does not own.
+     * sz is the size of a received frame in buf[1:],
+     * or 0 to init an empty frame for building.
+     * Use HeyMacFramePool::alloc() to get a frame with its own buffer.
+     */
     HeyMacFrame(uint8_t *buf, uint8_t sz);
 
-    /* Dealloc the frame */
     ~HeyMacFrame();
 
     /**
@@ -53,34 +151,99 @@ public:
     /** Returns the number of bytes used by the frm */
     uint16_t get_frm_sz(void);
 
+    /** Returns a reference to the payload and its size */
+    uint8_t *get_payld(void);
+    uint8_t get_payld_sz(void);
+
+    /** Sets or clears FCTL.P to tell the receiver another frame follows */
+    void set_pending(bool pending);
+    bool is_pending(void);
+
+    /**
+     * Writes a compile-time shaped header (see HeyMacHdr) in one call.
+     * Takes the place of set_protocol() through set_src_addr().
+     */
+    template <typename HDR>
+    void set_hdr(typename HDR::addr_t src_addr, typename HDR::addr_t dst_addr = 0, uint16_t net_id = 0)
+    {
+        HDR::write(_frm, src_addr, dst_addr, net_id);
+        _ie_sz = 0;
+        _fld_offset[FLD_NETID] = FRM_IDX_NETID;
+        _fld_offset[FLD_DST] = HDR::DST_OFFSET;
+        _fld_offset[FLD_IE] = HDR::SRC_OFFSET;
+        _fld_offset[FLD_SRC] = HDR::SRC_OFFSET;
+        _fld_offset[FLD_PAYLD] = HDR::PAYLD_OFFSET;
+        _fld_offset[FLD_MIC] = HDR::PAYLD_OFFSET + _payld_sz;
+        _fld_offset[FLD_MHOP] = HDR::PAYLD_OFFSET + _payld_sz + _mic_sz;
+    }
+
     // When building a frame, perform calls in this order:
     void set_protocol(hm_pidfld_t8 pidfld);
     void set_net_id(uint16_t net_id);
     void set_dst_addr(uint16_t dst_addr);
     void set_dst_addr(uint64_t dst_addr);
+    bool add_ie(uint8_t type, uint8_t const *data, uint8_t sz);
     void set_src_addr(uint16_t src_addr);
     void set_src_addr(uint64_t src_addr);
     bool set_payld(uint8_t *payld, uint8_t sz);
     void set_payld_sz(uint8_t sz);
-    // TODO: set_mic()
     bool set_mhop(uint8_t hops, uint16_t tx_addr);
     bool set_mhop(uint8_t hops, uint64_t tx_addr);
+    bool set_mic(HeyMacMic &mic); // needs a MIC IE from add_ie()
 
-    /* After receiving a frame, call parse() on it */
+    /**
+     * After receiving a frame, call parse() on it.
+     * Parsing is done by a HeyMacFrameView over this frame's buffer.
+     */
     bool parse(void);
-    // TODO: updt_mhop()
+
+    /**
+     * Like parse(), but the caller gives the view (over this frame's
+     * buffer and received size) and may keep using it afterwards,
+     * so the frame is parsed only once.
+     */
+    bool parse(HeyMacFrameView *r_view);
+
+    /** Returns true if a parsed frame carries a valid MIC */
+    bool verify_mic(HeyMacMic &mic);
+
+    /**
+     * Relays a parsed frame in place: decrements Hops and overwrites TxAddr.
+     * The frame is not re-serialized, so the same buffer
+     * may be given straight to HeyMacLayer::enq_tx_frame().
+     */
+    bool updt_mhop(uint16_t tx_addr);
+    bool updt_mhop(uint64_t tx_addr);
 
 private:
+    /** Indices into _fld_offset[], in the order the fields appear in a frame */
+    typedef enum
+    {
+        FLD_NETID = 0,
+        FLD_DST,
+        FLD_IE,
+        FLD_SRC,
+        FLD_PAYLD,
+        FLD_MIC,
+        FLD_MHOP,
+
+        FLD_CNT
+    } fld_t;
+
     uint8_t *_buf;
     uint8_t *_frm;
-    uint8_t _payld_offset;
+    uint8_t _fld_offset[FLD_CNT];
+    uint8_t _ie_sz;
     uint8_t _payld_sz;
     uint8_t _mic_sz;
     uint8_t _rxd_sz;
 
-    uint8_t _get_ie_sz(uint8_t ie_offset);
-    uint8_t _get_mic_sz(uint8_t ie_offset);
-    bool _validate_fields(void); // used by parse()
+    /**
+     * Updates the offsets of the given field and every field after it.
+     * Must be called whenever the FCTL bits or the size of a field
+     * before the given field changes.
+     */
+    void _updt_offsets(fld_t const fld);
 };
 
 #endif /* HEYMACFRAME_H_ */
@@ -0,0 +1,107 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "HeyMac.h"
+#include "HeyMacFrame.h"
+#include "HeyMacFrameBatch.h"
+#include "HeyMacFrameView.h"
+
+
+HeyMacFrameBatch::HeyMacFrameBatch()
+{
+    memset(&_tbl, 0, sizeof(_tbl));
+}
+
+HeyMacFrameBatch::~HeyMacFrameBatch()
+{
+}
+
+
+uint8_t HeyMacFrameBatch::parse(uint8_t const *const frms[], uint8_t const szs[], uint8_t cnt)
+{
+    uint8_t valid_cnt = 0;
+
+    if (cnt > HM_FRM_BATCH_CNT)
+    {
+        cnt = HM_FRM_BATCH_CNT;
+    }
+    memset(&_tbl, 0, sizeof(_tbl));
+    _tbl.cnt = cnt;
+
+    for (uint8_t i = 0; i < cnt; i++)
+    {
+        HeyMacFrameView view(frms[i], szs[i]);
+
+        if (view.parse())
+        {
+            _tbl.valid[i] = true;
+            _tbl.pid[i] = view.get_pid();
+            _tbl.fctl[i] = view.get_fctl();
+            if (view.has_net_id())
+            {
+                _tbl.net_id[i] = view.get_net_id();
+            }
+            if (view.has_dst_addr())
+            {
+                _tbl.dst_addr[i] = view.is_long_addr() ? view.get_dst_addr_long() : view.get_dst_addr_short();
+            }
+            if (view.has_src_addr())
+            {
+                _tbl.src_addr[i] = view.is_long_addr() ? view.get_src_addr_long() : view.get_src_addr_short();
+            }
+            _tbl.payld_offset[i] = view.get_payld() - view.get_frm();
+            _tbl.payld_sz[i] = view.get_payld_sz();
+            valid_cnt++;
+        }
+    }
+    return valid_cnt;
+}
+
+hm_frm_tbl_t const &HeyMacFrameBatch::get_tbl(void) const
+{
+    return _tbl;
+}
+
+uint8_t HeyMacFrameBatch::filter_net_id(uint16_t net_id, uint8_t r_idx[]) const
+{
+    uint8_t match_cnt = 0;
+
+    for (uint8_t i = 0; i < _tbl.cnt; i++)
+    {
+        if (_tbl.valid[i] && (_tbl.fctl[i] & FCTL_BIT_N) && (_tbl.net_id[i] == net_id))
+        {
+            r_idx[match_cnt++] = i;
+        }
+    }
+    return match_cnt;
+}
+
+uint8_t HeyMacFrameBatch::filter_dst_addr(uint64_t dst_addr, uint8_t r_idx[]) const
+{
+    uint8_t match_cnt = 0;
+
+    for (uint8_t i = 0; i < _tbl.cnt; i++)
+    {
+        if (_tbl.valid[i] && (_tbl.fctl[i] & FCTL_BIT_D) && (_tbl.dst_addr[i] == dst_addr))
+        {
+            r_idx[match_cnt++] = i;
+        }
+    }
+    return match_cnt;
+}
+
+uint8_t HeyMacFrameBatch::filter_src_addr(uint64_t src_addr, uint8_t r_idx[]) const
+{
+    uint8_t match_cnt = 0;
+
+    for (uint8_t i = 0; i < _tbl.cnt; i++)
+    {
+        if (_tbl.valid[i] && (_tbl.fctl[i] & FCTL_BIT_S) && (_tbl.src_addr[i] == src_addr))
+        {
+            r_idx[match_cnt++] = i;
+        }
+    }
+    return match_cnt;
+}
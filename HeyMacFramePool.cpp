@@ -0,0 +1,142 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#include <stdint.h>
+#include <new>
+
+#include "mbed.h"
+#include "mbed_atomic.h"
+
+#include "HeyMac.h"
+#include "HeyMacFrame.h"
+#include "HeyMacFramePool.h"
+
+
+MBED_STATIC_ASSERT(HM_FRMBUF_POOL_CNT <= 32, "HM_FRMBUF_POOL_CNT: exceeds the free bitmap");
+
+/*
+The app may fill the TX ring while the MAC thread's TX schedule is full,
+so both may hold HM_TX_QUEUE_CNT frames at once.  With every TX and RX
+queue full there must still be a frame to receive into.
+*/
+MBED_STATIC_ASSERT(HM_FRMBUF_POOL_CNT >= 2 * HM_TX_QUEUE_CNT + HM_RX_QUEUE_CNT + 1,
+                   "HM_FRMBUF_POOL_CNT: full queues would starve the receiver");
+
+/** A frame object and its buffer, allocated together */
+typedef struct
+{
+    alignas(HeyMacFrame) uint8_t frm_obj[sizeof(HeyMacFrame)];
+    uint8_t buf[HM_FRAME_SZ];
+    volatile uint8_t refcnt;
+} slab_t;
+
+static slab_t s_slabs[HM_FRMBUF_POOL_CNT];
+
+/** A set bit means the slab at that index is free */
+static volatile uint32_t s_free_bitmap = (HM_FRMBUF_POOL_CNT == 32)
+                                       ? 0xFFFFFFFF
+                                       : ((1UL << HM_FRMBUF_POOL_CNT) - 1);
+
+static volatile uint8_t s_in_use;
+static volatile uint8_t s_high_water;
+static volatile uint32_t s_alloc_cnt;
+static volatile uint32_t s_exhausted_cnt;
+
+
+/* Returns the index of the lowest set bit; bitmap MUST NOT be 0 */
+static inline uint8_t ctz(uint32_t bitmap)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(bitmap);
+#else
+    /* Other toolchains (ARMCC5, IAR) lack the builtin; the pool is at most 32 */
+    uint8_t idx = 0;
+
+    while ((bitmap & 1) == 0)
+    {
+        bitmap >>= 1;
+        idx++;
+    }
+    return idx;
+#endif
+}
+
+/* Returns the slab holding the given frame object */
+static slab_t *frm_to_slab(HeyMacFrame *frm)
+{
+    uint8_t idx = ((uint8_t *)frm - s_slabs[0].frm_obj) / sizeof(slab_t);
+
+    MBED_ASSERT(idx < HM_FRMBUF_POOL_CNT);
+    MBED_ASSERT((void *)frm == (void *)s_slabs[idx].frm_obj);
+
+    return &s_slabs[idx];
+}
+
+
+HeyMacFrame *HeyMacFramePool::alloc(uint8_t rxd_sz)
+{
+    HeyMacFrame *frm = nullptr;
+    uint32_t bitmap;
+    uint8_t idx;
+    uint8_t in_use;
+    uint8_t high_water;
+
+    /* Claim the lowest free slab; retry if another context claimed it first */
+    bitmap = core_util_atomic_load_u32(&s_free_bitmap);
+    while (bitmap != 0)
+    {
+        idx = ctz(bitmap);
+        if (core_util_atomic_cas_u32(&s_free_bitmap, &bitmap, bitmap & ~(1UL << idx)))
+        {
+            s_slabs[idx].refcnt = 1;
+            frm = new (s_slabs[idx].frm_obj) HeyMacFrame(s_slabs[idx].buf, rxd_sz);
+            break;
+        }
+    }
+
+    if (frm != nullptr)
+    {
+        core_util_atomic_incr_u32(&s_alloc_cnt, 1);
+        in_use = core_util_atomic_incr_u8(&s_in_use, 1);
+        high_water = core_util_atomic_load_u8(&s_high_water);
+        while ((in_use > high_water)
+            && !core_util_atomic_cas_u8(&s_high_water, &high_water, in_use))
+        {
+        }
+    }
+    else
+    {
+        core_util_atomic_incr_u32(&s_exhausted_cnt, 1);
+    }
+
+    return frm;
+}
+
+void HeyMacFramePool::ref(HeyMacFrame *frm)
+{
+    slab_t *slab = frm_to_slab(frm);
+
+    MBED_ASSERT(slab->refcnt > 0);
+    core_util_atomic_incr_u8(&slab->refcnt, 1);
+}
+
+void HeyMacFramePool::release(HeyMacFrame *frm)
+{
+    slab_t *slab = frm_to_slab(frm);
+    uint8_t idx = slab - s_slabs;
+
+    MBED_ASSERT(slab->refcnt > 0);
+    if (core_util_atomic_decr_u8(&slab->refcnt, 1) == 0)
+    {
+        frm->~HeyMacFrame();
+        core_util_atomic_decr_u8(&s_in_use, 1);
+        core_util_atomic_fetch_or_u32(&s_free_bitmap, 1UL << idx);
+    }
+}
+
+void HeyMacFramePool::get_stats(hm_frm_pool_stats_t *r_stats)
+{
+    r_stats->in_use = core_util_atomic_load_u8(&s_in_use);
+    r_stats->high_water = core_util_atomic_load_u8(&s_high_water);
+    r_stats->alloc_cnt = core_util_atomic_load_u32(&s_alloc_cnt);
+    r_stats->exhausted_cnt = core_util_atomic_load_u32(&s_exhausted_cnt);
+}
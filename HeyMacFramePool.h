@@ -0,0 +1,55 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#ifndef HEYMACFRAMEPOOL_H_
+#define HEYMACFRAMEPOOL_H_
+
+/**
+ * HeyMacFramePool
+ *
+ * A static pool of HM_FRMBUF_POOL_CNT frames.  Each slab holds
+ * a HeyMacFrame object and its buffer, so a frame needs no heap memory.
+ *
+ * alloc(), ref() and release() are lock-free and safe to call from ISRs.
+ * Frames are reference counted so one frame may be held by more than one
+ * owner (e.g. the TX queue and a capture path) at the same time.
+ * The slab returns to the pool when the last reference is released.
+ */
+
+#include <stdint.h>
+
+#include "HeyMac.h"
+#include "HeyMacFrame.h"
+
+
+/** Pool pressure statistics */
+typedef struct
+{
+    uint8_t in_use;         /* frames allocated now */
+    uint8_t high_water;     /* most frames ever allocated at once */
+    uint32_t alloc_cnt;     /* successful allocs */
+    uint32_t exhausted_cnt; /* allocs that failed because the pool was empty */
+} hm_frm_pool_stats_t;
+
+
+class HeyMacFramePool
+{
+public:
+    /**
+     * Returns a frame with a reference count of one,
+     * or nullptr if the pool is exhausted.
+     * If rxd_sz is nonzero, the frame is to be filled with received data;
+     * otherwise it is initialized for building.
+     */
+    static HeyMacFrame *alloc(uint8_t rxd_sz = 0);
+
+    /** Adds a reference to a frame from this pool */
+    static void ref(HeyMacFrame *frm);
+
+    /** Drops a reference; the frame returns to the pool when none remain */
+    static void release(HeyMacFrame *frm);
+
+    /** Copies the pool statistics into r_stats */
+    static void get_stats(hm_frm_pool_stats_t *r_stats);
+};
+
+#endif /* HEYMACFRAMEPOOL_H_ */
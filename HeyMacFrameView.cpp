@@ -0,0 +1,248 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#include <stdint.h>
+
+#include "mbed.h"
+
+#include "HeyMac.h"
+#include "HeyMacFrame.h"
+#include "HeyMacFrameView.h"
+#include "HeyMacIe.h"
+#include "utl_be.h"
+
+
+HeyMacFrameView::HeyMacFrameView(uint8_t const * frm, uint8_t sz)
+{
+    MBED_ASSERT(frm != nullptr);
+
+    _frm = frm;
+    _sz = sz;
+    _dst_offset = 0;
+    _ie_offset = 0;
+    _src_offset = 0;
+    _payld_offset = 0;
+    _mic_offset = 0;
+    _mhop_offset = 0;
+    _ie_sz = 0;
+    _payld_sz = 0;
+    _mic_sz = 0;
+}
+
+
+/*
+Returns true/false if the data in the span is a valid/invalid HeyMac frame.
+
+Walks the header once and records where every field lives.
+Never reads beyond the span given to the constructor.
+*/
+bool HeyMacFrameView::parse(void)
+{
+    bool success = false;
+    uint8_t fctl;
+    uint8_t addr_sz;
+    uint8_t mhop_sz;
+    uint16_t offset;
+
+    if (_sz > FRM_IDX_FCTL)
+    {
+        fctl = _frm[FRM_IDX_FCTL];
+        addr_sz = (fctl & FCTL_BIT_L) ? 8 : 2;
+        mhop_sz = (fctl & FCTL_BIT_M) ? 1 + addr_sz : 0;
+
+        offset = FRM_IDX_NETID;
+        if (fctl & FCTL_BIT_N)
+        {
+            offset += 2;
+        }
+        _dst_offset = offset;
+        if (fctl & FCTL_BIT_D)
+        {
+            offset += addr_sz;
+        }
+        _ie_offset = offset;
+        if ((fctl & FCTL_BIT_I) && (offset < _sz))
+        {
+            /* One pass over the IEs finds their size and the MIC size */
+            _ie_sz = HeyMacIe::scan(&_frm[offset], _sz - offset, &_mic_sz);
+            offset += _ie_sz;
+        }
+        _src_offset = offset;
+        if (fctl & FCTL_BIT_S)
+        {
+            offset += addr_sz;
+        }
+        _payld_offset = offset;
+
+        /* The IEs must be well-formed and the payload must not be empty */
+        if (((_ie_sz > 0) || ((fctl & FCTL_BIT_I) == 0))
+         && ((offset + _mic_sz + mhop_sz) < _sz))
+        {
+            _payld_sz = _sz - mhop_sz - _mic_sz - offset;
+            _mic_offset = _payld_offset + _payld_sz;
+            _mhop_offset = _mic_offset + _mic_sz;
+            success = _validate_fields();
+        }
+    }
+    return success;
+}
+
+
+uint8_t const *HeyMacFrameView::get_frm(void) const
+{
+    return _frm;
+}
+
+uint8_t HeyMacFrameView::get_frm_sz(void) const
+{
+    return _sz;
+}
+
+uint8_t HeyMacFrameView::get_pid(void) const
+{
+    return _frm[FRM_IDX_PID];
+}
+
+uint8_t HeyMacFrameView::get_fctl(void) const
+{
+    return _frm[FRM_IDX_FCTL];
+}
+
+bool HeyMacFrameView::is_extended(void) const
+{
+    return (_frm[FRM_IDX_FCTL] & FCTL_BIT_X) != 0;
+}
+
+bool HeyMacFrameView::is_long_addr(void) const
+{
+    return (_frm[FRM_IDX_FCTL] & FCTL_BIT_L) != 0;
+}
+
+bool HeyMacFrameView::is_mhop(void) const
+{
+    return (_frm[FRM_IDX_FCTL] & FCTL_BIT_M) != 0;
+}
+
+bool HeyMacFrameView::is_pending(void) const
+{
+    return (_frm[FRM_IDX_FCTL] & FCTL_BIT_P) != 0;
+}
+
+bool HeyMacFrameView::has_net_id(void) const
+{
+    return (_frm[FRM_IDX_FCTL] & FCTL_BIT_N) != 0;
+}
+
+bool HeyMacFrameView::has_dst_addr(void) const
+{
+    return (_frm[FRM_IDX_FCTL] & FCTL_BIT_D) != 0;
+}
+
+bool HeyMacFrameView::has_ies(void) const
+{
+    return (_frm[FRM_IDX_FCTL] & FCTL_BIT_I) != 0;
+}
+
+bool HeyMacFrameView::has_src_addr(void) const
+{
+    return (_frm[FRM_IDX_FCTL] & FCTL_BIT_S) != 0;
+}
+
+uint16_t HeyMacFrameView::get_net_id(void) const
+{
+    return be16_ld(&_frm[FRM_IDX_NETID]);
+}
+
+uint16_t HeyMacFrameView::get_dst_addr_short(void) const
+{
+    return be16_ld(&_frm[_dst_offset]);
+}
+
+uint64_t HeyMacFrameView::get_dst_addr_long(void) const
+{
+    return be64_ld(&_frm[_dst_offset]);
+}
+
+uint16_t HeyMacFrameView::get_src_addr_short(void) const
+{
+    return be16_ld(&_frm[_src_offset]);
+}
+
+uint64_t HeyMacFrameView::get_src_addr_long(void) const
+{
+    return be64_ld(&_frm[_src_offset]);
+}
+
+uint8_t const *HeyMacFrameView::get_ies(void) const
+{
+    return &_frm[_ie_offset];
+}
+
+uint8_t HeyMacFrameView::get_ie_sz(void) const
+{
+    return _ie_sz;
+}
+
+uint8_t const *HeyMacFrameView::get_payld(void) const
+{
+    return &_frm[_payld_offset];
+}
+
+uint8_t HeyMacFrameView::get_payld_sz(void) const
+{
+    return _payld_sz;
+}
+
+uint8_t const *HeyMacFrameView::get_mic(void) const
+{
+    return &_frm[_mic_offset];
+}
+
+uint8_t HeyMacFrameView::get_mic_sz(void) const
+{
+    return _mic_sz;
+}
+
+uint8_t HeyMacFrameView::get_hops(void) const
+{
+    return _frm[_mhop_offset];
+}
+
+uint16_t HeyMacFrameView::get_tx_addr_short(void) const
+{
+    return be16_ld(&_frm[_mhop_offset + 1]);
+}
+
+uint64_t HeyMacFrameView::get_tx_addr_long(void) const
+{
+    return be64_ld(&_frm[_mhop_offset + 1]);
+}
+
+
+// PRIVATE
+
+/*
+Returns true if no fields are invalid.
+Assumes the _frm contents' size has been validated by caller
+*/
+bool HeyMacFrameView::_validate_fields(void)
+{
+    bool success = true;
+
+    /* Only CSMA_V0, TDMA_V0 and FLOOD are supported at this time */
+    success = success && ((_frm[FRM_IDX_PID] == HM_PIDFLD_CSMA_V0)
+                       || (_frm[FRM_IDX_PID] == HM_PIDFLD_TDMA_V0)
+                       || (_frm[FRM_IDX_PID] == HM_PIDFLD_FLOOD));
+
+    /*
+    Any eXtended frame is valid because remaining contents are undefined
+    now check non-eXtended frames
+    */
+    if ((_frm[FRM_IDX_FCTL] & FCTL_BIT_X) == 0)
+    {
+        // TODO: validate NetId
+        // TODO: validate DstAddr (HONR)
+        // TODO: validate SrcAddr (HONR)
+        // TODO: validate Payld has MAC or APv6 header
+    }
+    return success;
+}
@@ -0,0 +1,89 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#ifndef HEYMACFRAMEVIEW_H_
+#define HEYMACFRAMEVIEW_H_
+
+#include <stdint.h>
+
+#include "HeyMac.h"
+#include "HeyMacFrame.h"
+
+
+/**
+ * HeyMacFrameView
+ *
+ * A read-only view of a HeyMac frame that lives in someone else's memory
+ * (a FIFO read buffer, a capture file, a ring slot).
+ * The view does not own, allocate or copy the frame bytes;
+ * the caller MUST keep the bytes alive and unchanged while the view is in use.
+ */
+class HeyMacFrameView
+{
+public:
+    /** Init with the frame (NOT the SPI command byte) and its size */
+    HeyMacFrameView(uint8_t const *frm, uint8_t sz);
+
+    /**
+     * Returns true/false if the bytes are a valid/invalid HeyMac frame.
+     * Every getter below is meaningful only after parse() returns true.
+     */
+    bool parse(void);
+
+    uint8_t const *get_frm(void) const;
+    uint8_t get_frm_sz(void) const;
+
+    uint8_t get_pid(void) const;
+    uint8_t get_fctl(void) const;
+
+    bool is_extended(void) const;
+    bool is_long_addr(void) const;
+    bool is_mhop(void) const;
+    bool is_pending(void) const;
+    bool has_net_id(void) const;
+    bool has_dst_addr(void) const;
+    bool has_ies(void) const;
+    bool has_src_addr(void) const;
+
+    uint16_t get_net_id(void) const;
+
+    /** The short or long getter must match is_long_addr() */
+    uint16_t get_dst_addr_short(void) const;
+    uint64_t get_dst_addr_long(void) const;
+    uint16_t get_src_addr_short(void) const;
+    uint64_t get_src_addr_long(void) const;
+
+    /**
+     * Returns a reference to the IEs and their total size (0 if none).
+     * Use a HeyMacIeIter to read the individual IEs.
+     */
+    uint8_t const *get_ies(void) const;
+    uint8_t get_ie_sz(void) const;
+
+    uint8_t const *get_payld(void) const;
+    uint8_t get_payld_sz(void) const;
+
+    uint8_t const *get_mic(void) const;
+    uint8_t get_mic_sz(void) const;
+
+    /** Multihop fields.  Only meaningful if is_mhop() */
+    uint8_t get_hops(void) const;
+    uint16_t get_tx_addr_short(void) const;
+    uint64_t get_tx_addr_long(void) const;
+
+private:
+    uint8_t const *_frm;
+    uint8_t _sz;
+    uint8_t _dst_offset;
+    uint8_t _ie_offset;
+    uint8_t _src_offset;
+    uint8_t _payld_offset;
+    uint8_t _mic_offset;
+    uint8_t _mhop_offset;
+    uint8_t _ie_sz;
+    uint8_t _payld_sz;
+    uint8_t _mic_sz;
+
+    bool _validate_fields(void); // used by parse()
+};
+
+#endif /* HEYMACFRAMEVIEW_H_ */
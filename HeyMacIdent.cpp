@@ -12,6 +12,7 @@
 
 #include "HeyMac.h"
 #include "HeyMacIdent.h"
+#include "utl_be.h"
 
 using namespace std;
 
@@ -32,11 +33,10 @@ void HeyMacIdent::copy_tac_id_into(char tac_id[HM_IDENT_TAC_ID_SZ])
 }
 
 
+/* Returns the first 64 bits of the long address, MSB first */
 uint64_t HeyMacIdent::get_long_addr(void)
 {
-    uint64_t addr;
-    memcpy(&addr, _long_addr, sizeof(addr)); // FIXME: endianness
-    return addr;
+    return be64_ld(_long_addr);
 }
 
 
@@ -0,0 +1,183 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mbed.h"
+
+#include "HeyMac.h"
+#include "HeyMacIe.h"
+
+
+static uint8_t const IE_SZ_CODE_SHIFT = 5;
+static uint8_t const IE_TYPE_MASK = 0x1F;
+static uint8_t const IE_SZ_CODE_VAR = 6;
+
+/* Sentinel values in s_ie_data_sz_lut */
+static uint8_t const IE_SZ_VAR = 0xFE;
+static uint8_t const IE_SZ_RSVD = 0xFF;
+
+/** IE data size indexed by the descriptor's size code */
+static uint8_t const s_ie_data_sz_lut[1 << (8 - IE_SZ_CODE_SHIFT)] =
+{
+    /* 0 */ 0,
+    /* 1 */ 1,
+    /* 2 */ 2,
+    /* 3 */ 4,
+    /* 4 */ 8,
+    /* 5 */ 16,
+    /* 6 */ IE_SZ_VAR,
+    /* 7 */ IE_SZ_RSVD,
+};
+
+/** MIC size indexed by IE type (0 for types that do not give a MIC) */
+static uint8_t const s_mic_sz_lut[HM_IE_TYPE_MAX + 1] =
+{
+    /* HM_IE_TERM */    0,
+    /* HM_IE_MIC_32 */  4,
+    /* HM_IE_MIC_64 */  8,
+    /* HM_IE_MIC_128 */ 16,
+    /* remaining types give no MIC */
+};
+
+
+uint8_t HeyMacIe::scan(uint8_t const *ies, uint8_t sz, uint8_t *r_mic_sz)
+{
+    uint16_t offset = 0;
+    uint8_t ies_sz = 0;
+    uint8_t desc;
+    uint8_t data_sz;
+    uint8_t mic_sz = 0;
+
+    /* Results for a malformed list or one without a terminator within sz */
+    *r_mic_sz = 0;
+
+    while (offset < sz)
+    {
+        desc = ies[offset];
+        if (desc == HM_IE_TERM)
+        {
+            ies_sz = offset + 1;
+            *r_mic_sz = mic_sz;
+            break;
+        }
+
+        data_sz = s_ie_data_sz_lut[desc >> IE_SZ_CODE_SHIFT];
+        if (data_sz == IE_SZ_VAR)
+        {
+            offset++;
+            if (offset >= sz)
+            {
+                break;
+            }
+            data_sz = ies[offset];
+        }
+        else if (data_sz == IE_SZ_RSVD)
+        {
+            break;
+        }
+
+        if (s_mic_sz_lut[desc & IE_TYPE_MASK])
+        {
+            mic_sz = s_mic_sz_lut[desc & IE_TYPE_MASK];
+        }
+        offset += 1 + data_sz;
+    }
+
+    return ies_sz;
+}
+
+
+uint8_t HeyMacIe::write(uint8_t *buf, uint8_t buf_sz, uint8_t type, uint8_t const *data, uint8_t sz)
+{
+    uint8_t sz_code;
+    uint8_t hdr_sz = 1;
+    uint8_t wr_sz = 0;
+
+    MBED_ASSERT((type != HM_IE_TERM) && (type <= HM_IE_TYPE_MAX));
+
+    /* Use a fixed size code if one matches; otherwise use a length octet */
+    for (sz_code = 0; sz_code < IE_SZ_CODE_VAR; sz_code++)
+    {
+        if (s_ie_data_sz_lut[sz_code] == sz)
+        {
+            break;
+        }
+    }
+    if (sz_code == IE_SZ_CODE_VAR)
+    {
+        hdr_sz = 2;
+    }
+
+    if ((uint16_t)hdr_sz + sz <= buf_sz)
+    {
+        buf[0] = (sz_code << IE_SZ_CODE_SHIFT) | type;
+        if (hdr_sz == 2)
+        {
+            buf[1] = sz;
+        }
+        memcpy(&buf[hdr_sz], data, sz);
+        wr_sz = hdr_sz + sz;
+    }
+
+    return wr_sz;
+}
+
+uint8_t HeyMacIe::get_mic_sz(uint8_t type)
+{
+    return s_mic_sz_lut[type & IE_TYPE_MASK];
+}
+
+bool HeyMacIe::get_seq(uint8_t const *ies, uint8_t sz, uint32_t *r_seq)
+{
+    HeyMacIeIter iter(ies, sz);
+    hm_ie_t ie;
+    bool found = false;
+    uint8_t i;
+
+    while (!found && iter.next(&ie))
+    {
+        if ((HM_IE_SEQ == ie.type) && (ie.sz > 0) && (ie.sz <= 4))
+        {
+            *r_seq = 0;
+            for (i = 0; i < ie.sz; i++)
+            {
+                *r_seq = (*r_seq << 8) | ie.data[i];
+            }
+            found = true;
+        }
+    }
+    return found;
+}
+
+
+HeyMacIeIter::HeyMacIeIter(uint8_t const *ies, uint8_t sz)
+{
+    _ies = ies;
+    _sz = sz;
+    _offset = 0;
+}
+
+bool HeyMacIeIter::next(hm_ie_t *ie)
+{
+    bool success = false;
+    uint8_t desc;
+    uint8_t data_sz;
+
+    if ((_offset < _sz) && (_ies[_offset] != HM_IE_TERM))
+    {
+        desc = _ies[_offset++];
+        data_sz = s_ie_data_sz_lut[desc >> IE_SZ_CODE_SHIFT];
+        if (data_sz == IE_SZ_VAR)
+        {
+            data_sz = _ies[_offset++];
+        }
+
+        ie->type = desc & IE_TYPE_MASK;
+        ie->sz = data_sz;
+        ie->data = &_ies[_offset];
+        _offset += data_sz;
+        success = true;
+    }
+    return success;
+}
@@ -0,0 +1,100 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#ifndef HEYMACIE_H_
+#define HEYMACIE_H_
+
+/**
+ * HeyMac Information Elements (IEs)
+ *
+ * The IEs field is a list of IEs ended by the terminator IE.
+ * Each IE starts with a descriptor octet:
+ *
+ *   bits [7:5]  size code (see below)
+ *   bits [4:0]  IE type (hm_ie_type_t8)
+ *
+ * The size code gives the number of data octets that follow
+ * the descriptor: 0, 1, 2, 4, 8, 16, or variable.  A variable size IE
+ * has a length octet after the descriptor.  Size code 7 is reserved.
+ * The terminator IE is the single octet 0x00.
+ */
+
+#include <stdint.h>
+
+#include "HeyMac.h"
+
+
+/* IE types */
+typedef enum
+{
+    HM_IE_TERM = 0,         /* End of the IEs list (descriptor is 0x00) */
+    HM_IE_MIC_32 = 1,       /* Frame counter for a 32-bit MIC */
+    HM_IE_MIC_64 = 2,       /* Frame counter for a 64-bit MIC */
+    HM_IE_MIC_128 = 3,      /* Frame counter for a 128-bit MIC */
+    HM_IE_SEQ = 4,          /* Sequence number */
+
+    HM_IE_APP_MIN = 16,     /* Types 16..31 are application defined */
+    HM_IE_TYPE_MAX = 31,
+} hm_ie_type_t8;
+
+/** A decoded IE.  data refers into the frame, it is not a copy */
+typedef struct
+{
+    uint8_t type;
+    uint8_t sz;
+    uint8_t const *data;
+} hm_ie_t;
+
+
+class HeyMacIe
+{
+public:
+    /**
+     * Scans the IEs list in one pass.
+     * Returns the size of the list including the terminator
+     * and fills r_mic_sz with the size of the MIC (0 if there is none).
+     * Returns 0 if the list is malformed or runs past sz.
+     */
+    static uint8_t scan(uint8_t const *ies, uint8_t sz, uint8_t *r_mic_sz);
+
+    /**
+     * Writes one IE (descriptor, length octet if needed, data) to buf.
+     * Returns the number of octets written,
+     * or 0 if the IE would not fit in buf_sz.
+     */
+    static uint8_t write(uint8_t *buf, uint8_t buf_sz, uint8_t type, uint8_t const *data, uint8_t sz);
+
+    /** Returns the MIC size given by an IE type, or 0 if the type is not a MIC IE */
+    static uint8_t get_mic_sz(uint8_t type);
+
+    /**
+     * Returns true and fills r_seq with the value of the first HM_IE_SEQ
+     * (1 to 4 octets, big-endian) in a list validated by scan()
+     */
+    static bool get_seq(uint8_t const *ies, uint8_t sz, uint32_t *r_seq);
+};
+
+
+/**
+ * HeyMacIeIter
+ *
+ * Iterates over an IEs list that has been validated by HeyMacIe::scan()
+ * (for example, the IEs of a parsed HeyMacFrameView).
+ */
+class HeyMacIeIter
+{
+public:
+    HeyMacIeIter(uint8_t const *ies, uint8_t sz);
+
+    /**
+     * Fills ie with the next IE and returns true.
+     * Returns false at the terminator or the end of the list.
+     */
+    bool next(hm_ie_t *ie);
+
+private:
+    uint8_t const *_ies;
+    uint8_t _sz;
+    uint8_t _offset;
+};
+
+#endif /* HEYMACIE_H_ */
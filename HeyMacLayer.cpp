@@ -9,10 +9,13 @@
  * The radio is normally listening on one frequency.
  * If a valid header is heard and a frame is received,
  * the frame is processed and the radio returns to listening.
- * If a frame appears in the tx_queue, the radio exits listening,
+ * When a frame in the tx schedule is due, the radio exits listening,
  * transmits the frame(s) and then returns to listening.
  * After transmitting or receiving, any outstanding settings are applied
  * to the radio.
+ * In TDMA mode, once the superframe is synced, the radio instead idles
+ * between slots and only transmits or opens a receive window
+ * at the start of a slot allocated for it.
  *
  * ===============  ==================  ==========================================
  * State            Event               Action
@@ -21,31 +24,64 @@
  *                                      Transitions to Lstning.
  * Setting          *                   Applies outstanding settings with the radio
  *                                      in standby mode and possibly sleep mode.
- *                                      If the tx_queue is non-empty, transitions to Txing;
+ *                                      Drops due flood relays that were suppressed.
+ *                                      In synced TDMA, transitions to Slotting.
+ *                                      If a frame in the tx schedule is due
+ *                                      and TX is not held off (CSMA only),
+ *                                      transitions to Cading;
  *                                      otherwise transitions to Lstning.
- * Lstning          EVT_TX_RDY          Sets the radio to standby mode and
+ * Lstning          EVT_TX_RDY          (posted by the timer armed for the earliest
+ *                                      scheduled frame)
+ *                                      Sets the radio to standby mode and
  *                                      transitions to the Setting state.
  *                  EVT_THRD_PRDC       Updates RX channel meta-data,
+ *                                      expires stale routes,
  *                                      then remains in Lstning.
  *                  EVT_DIO_VALID_HDR   Transitions to Rxing so frame reception
  *                                      is not disturbed by other events.
- * Rxing            EVT_DIO_RX_DONE     Processes the received frame,
- *                                      then transitions to Setting.
- * Txing            *                   Transmits the frame from the front of the tx_queue,
+ * Rxing            EVT_DIO_RX_DONE     Processes the received frame, updates the
+ *                                      sender's entry in the neighbor table
+ *                                      (and schedules the relay of a new flood frame
+ *                                      or relays a routed frame to its next hop),
  *                                      then transitions to Setting.
+ * Cading           EVT_DIO_CAD_DONE    If the channel is clear, transitions to Txing;
+ *                                      otherwise holds off TX for a random backoff
+ *                                      (or drops the frame after too many retries)
+ *                                      and transitions to Setting.
+ * Slotting         *                   Prepares the radio for the next TX, beacon
+ *                                      or RX slot and arms the slot timer.
+ *                  EVT_SLOT            Starts TX and transitions to Txing,
+ *                                      or opens a receive window (RXONCE).
+ *                  EVT_DIO_VALID_HDR   Transitions to Rxing.
+ *                  EVT_DIO_RX_TMOUT    Transitions to Setting.
+ * Txing            *                   Transmits the earliest due frame in the tx schedule.
+ *                  EVT_DIO_TX_DONE     Transmits the next due frame if the radio
+ *                                      settings are unchanged (a burst, CSMA only);
+ *                                      otherwise transitions to Setting.
  * ===============  ==================  ==========================================
  */
 
 #include <stdint.h>
-#include <deque>
 
 #include "mbed.h"
 
 #include "HeyMacIdent.h"
 #include "HeyMacLayer.h"
 #include "HeyMacFrame.h"
+#include "HeyMacFramePool.h"
 #include "HeyMacCmd.h"
+#include "HeyMacTxSched.h"
+#include "HeyMacTxRing.h"
+#include "HeyMacRxQueue.h"
+#include "HeyMacCsma.h"
+#include "HeyMacTdma.h"
+#include "HeyMacFlood.h"
+#include "HeyMacNgbrTbl.h"
+#include "HeyMacRoute.h"
+#include "HeyMacFrameView.h"
+#include "HeyMacIe.h"
 #include "SX127xRadio.h"
+#include "utl_be.h"
 
 using namespace std;
 
@@ -53,6 +89,32 @@ using namespace std;
 static int const THRD_STACK_SZ = 6 * 1024;
 static uint32_t const THRD_PRDC_MS = 100;
 
+/* How long TX waits for the frame that follows one with FCTL.P set */
+static uint32_t const RX_HOLD_MS = 400;
+
+/* Octets read before the filters decide: PID, FCTL, NetId, long DstAddr */
+static uint8_t const RX_HDR_PEEK_SZ = 1 + 1 + 2 + 8;
+
+/* The link quality assumed for an advertiser that is not in the neighbor table */
+static uint8_t const RTE_LQ_UNKNOWN = 8;
+
+/* Neighbors not heard for this long are left out of our beacons */
+static uint32_t const NGBR_MAX_AGE_MS = 60 * 1000;
+
+/* Routes not advertised for this long are removed */
+static uint32_t const ROUTE_MAX_AGE_MS = 3 * 60 * 1000;
+
+/*
+Beacons (our neighbors and routes) go out this often, give or take
+half the jitter so neighbors' beacons do not stay in step.
+Well inside NGBR_MAX_AGE_MS so one lost beacon does not drop a neighbor.
+*/
+static uint32_t const BCN_PRDC_MS = 15 * 1000;
+static uint32_t const BCN_JITTER_MS = 4 * 1000;
+
+/* Time to load the FIFO and set up the radio before a TDMA slot starts */
+static uint32_t const SLOT_LEAD_US = 5000;
+
 #define SM_HANDLED() retval = SM_RET_HANDLED
 #define SM_TRAN(next_st_clbk) this->_st_handler = next_st_clbk; retval = SM_RET_TRAN
 
@@ -81,13 +143,13 @@ enum
     EVT_DIO_PAYLD_CRC_ERR   = 1 << 15,  /** LoRa radio DIO PayloadCrcError */
 
     /**
-     * When a frame is added to the transmit queue,
+     * When a scheduled frame is due,
      * this signal is dispatched to cause the Listening state
      * to stop and transfer through Setting to Transmitting.
      * If the state machine is in the Receiving or Transmitting
      * states when this signal is dispatched, this signal is ignored,
      * and the designed progression from Receiving and Transmitting
-     * through Setting will detect a non-empty tansmit queue
+     * through Setting will detect the due frame
      * and transition to the Transmitting state then.
      */
     EVT_TX_RDY              = 1 << 16,
@@ -95,14 +157,61 @@ enum
     /** Hardware User button event */
     EVT_BTN                 = 1 << 17,
 
-    EVT_ALL = (EVT_BTN << 1) - 1
+    /**
+     * A frame was put in the transmit ring.
+     * Handled in any state by moving it into the transmit schedule.
+     */
+    EVT_TX_ENQ              = 1 << 18,
+
+    /** A TDMA slot that Slotting prepared the radio for has started */
+    EVT_SLOT                = 1 << 19,
+
+    /**
+     * A set_*() call staged new settings.
+     * Handled in any state by applying them.
+     */
+    EVT_CFG                 = 1 << 20,
+
+    EVT_ALL = (EVT_CFG << 1) - 1
+};
+
+/** Which staged settings are waiting to be applied */
+enum
+{
+    CFG_CSMA        = 1 << 0,
+    CFG_TDMA        = 1 << 1,
+    CFG_TDMA_SLOTS  = 1 << 2,
+    CFG_TDMA_ON     = 1 << 3,
+    CFG_FLOOD       = 1 << 4,
+    CFG_RX_FILTER   = 1 << 5,
 };
 
 
 HeyMacLayer::HeyMacLayer(char const *cred_fn)
     :
-    _tx_queue(deque<tx_data_t>(0))
+    _tx_frm(nullptr),
+    _tx_done_clbk(nullptr),
+    _tx_burst_cnt(0),
+    _rx_clbk(nullptr),
+    _rx_hdr_us(0),
+    _rx_hold(false),
+    _rx_hold_until_ms(0),
+    _rx_net_id(0),
+    _rx_short_addr(0),
+    _tx_backoff(false),
+    _tx_backoff_until_ms(0),
+    _tdma_on(false),
+    _slot_type(HM_SLOT_IDLE),
+    _rx_ngbr(nullptr),
+    _bcn_next_ms(0)
 {
+    memset(&_rx_stats, 0, sizeof(_rx_stats));
+    memset(&_cfg_stg, 0, sizeof(_cfg_stg));
+
+    /* Neighbors' beacons and route advertisements feed our tables */
+    _cmd_dispatch.set_hndlr(HM_CID_CBCN, callback(this, &HeyMacLayer::_cbcn_hndlr));
+    _cmd_dispatch.set_hndlr(HM_CID_RTE, callback(this, &HeyMacLayer::_rte_hndlr));
+
     /* Thread stuff */
     _thread = new Thread(osPriorityNormal, THRD_STACK_SZ, nullptr, "HMLayer");
     _period_ms = THRD_PRDC_MS;
@@ -136,19 +245,194 @@ HeyMacLayer::~HeyMacLayer()
 }
 
 
-void HeyMacLayer::enq_tx_frame(HeyMacFrame *frm, uint32_t tx_time)
+hm_retval_t HeyMacLayer::enq_tx_frame(HeyMacFrame *frm, uint32_t tx_time)
 {
-    tx_data_t tx_data;
+    hm_retval_t retval = HM_RET_FULL;
 
-    tx_data.frm = frm;
-    tx_data.at_time_ms = tx_time;
-    // TODO: Wrap _tx_queue access with smphr?
-    _tx_queue.push_back(tx_data);
+    MBED_ASSERT(frm != nullptr);
 
-    if (0/*ASAP*/ == tx_time) // TODO if (tx_time < now + 100ms prdc)
+    if (0/*ASAP*/ == tx_time)
     {
-        _thread->flags_set(EVT_TX_RDY);
+        tx_time = _now_ms();
+    }
+
+    if (_tx_ring.push(frm, tx_time))
+    {
+        _thread->flags_set(EVT_TX_ENQ);
+        retval = HM_RET_OK;
+    }
+    return retval;
+}
+
+void HeyMacLayer::set_tx_done_clbk(Callback<void(HeyMacFrame *)> tx_done_clbk)
+{
+    /* A Callback is several words; the thread could see it half-written */
+    MBED_ASSERT(_thread->get_state() == Thread::Inactive);
+    _tx_done_clbk = tx_done_clbk;
+}
+
+void HeyMacLayer::get_tx_stats(hm_tx_sched_stats_t *r_stats)
+{
+    _tx_sched.get_stats(r_stats);
+}
+
+uint32_t HeyMacLayer::get_tx_enq_fail_cnt(void)
+{
+    return _tx_ring.get_fail_cnt();
+}
+
+uint32_t HeyMacLayer::get_tx_burst_cnt(void)
+{
+    return _tx_burst_cnt;
+}
+
+bool HeyMacLayer::set_ext_hndlr(uint8_t ext_type, HeyMacExt::hndlr_t hndlr)
+{
+    MBED_ASSERT(_thread->get_state() == Thread::Inactive);
+    return _ext.set_hndlr(ext_type, hndlr);
+}
+
+void HeyMacLayer::clr_ext_hndlr(uint8_t ext_type)
+{
+    MBED_ASSERT(_thread->get_state() == Thread::Inactive);
+    _ext.clr_hndlr(ext_type);
+}
+
+void HeyMacLayer::set_cmd_hndlr(hm_cid_t8 cid, HeyMacCmdDispatch::hndlr_t hndlr)
+{
+    MBED_ASSERT(_thread->get_state() == Thread::Inactive);
+    _cmd_dispatch.set_hndlr(cid, hndlr);
+}
+
+void HeyMacLayer::clr_cmd_hndlr(hm_cid_t8 cid)
+{
+    MBED_ASSERT(_thread->get_state() == Thread::Inactive);
+    _cmd_dispatch.clr_hndlr(cid);
+}
+
+bool HeyMacLayer::get_rx_rec(hm_rx_rec_t *r_rec)
+{
+    return _rx_queue.get(r_rec);
+}
+
+void HeyMacLayer::set_rx_clbk(Callback<void()> rx_clbk)
+{
+    MBED_ASSERT(_thread->get_state() == Thread::Inactive);
+    _rx_clbk = rx_clbk;
+}
+
+void HeyMacLayer::get_rx_stats(hm_rx_stats_t *r_stats)
+{
+    *r_stats = _rx_stats;
+}
+
+void HeyMacLayer::set_rx_filter(uint16_t net_id, uint16_t short_addr)
+{
+    _cfg_mutex.lock();
+    _cfg_stg.net_id = net_id;
+    _cfg_stg.short_addr = short_addr;
+    _cfg_stg.pending |= CFG_RX_FILTER;
+    _cfg_mutex.unlock();
+    _post_cfg();
+}
+
+void HeyMacLayer::set_csma_cfg(hm_csma_cfg_t const *cfg)
+{
+    _cfg_mutex.lock();
+    _cfg_stg.csma = *cfg;
+    _cfg_stg.pending |= CFG_CSMA;
+    _cfg_mutex.unlock();
+    _post_cfg();
+}
+
+void HeyMacLayer::get_csma_stats(hm_csma_stats_t *r_stats)
+{
+    _csma.get_stats(r_stats);
+}
+
+void HeyMacLayer::set_tdma_cfg(hm_tdma_cfg_t const *cfg)
+{
+    _cfg_mutex.lock();
+    _cfg_stg.tdma = *cfg;
+    _cfg_stg.pending |= CFG_TDMA;
+    _cfg_mutex.unlock();
+    _post_cfg();
+}
+
+void HeyMacLayer::set_tdma_slot(uint8_t slot, hm_slot_t8 type)
+{
+    MBED_ASSERT((slot < HM_TDMA_SLOT_MAX) && (type != HM_SLOT_BCN));
+
+    _cfg_mutex.lock();
+    _cfg_stg.slots[slot] = type;
+    _cfg_stg.slots_dirty |= 1ULL << slot;
+    _cfg_stg.pending |= CFG_TDMA_SLOTS;
+    _cfg_mutex.unlock();
+    _post_cfg();
+}
+
+void HeyMacLayer::tdma_start(bool is_coord)
+{
+    _cfg_mutex.lock();
+    _cfg_stg.tdma_on = true;
+    _cfg_stg.tdma_coord = is_coord;
+    _cfg_stg.pending |= CFG_TDMA_ON;
+    _cfg_mutex.unlock();
+    _post_cfg();
+}
+
+void HeyMacLayer::tdma_stop(void)
+{
+    _cfg_mutex.lock();
+    _cfg_stg.tdma_on = false;
+    _cfg_stg.pending |= CFG_TDMA_ON;
+    _cfg_mutex.unlock();
+    _post_cfg();
+}
+
+void HeyMacLayer::get_tdma_stats(hm_tdma_stats_t *r_stats)
+{
+    _tdma.get_stats(r_stats);
+}
+
+void HeyMacLayer::set_flood_cfg(hm_flood_cfg_t const *cfg)
+{
+    _cfg_mutex.lock();
+    _cfg_stg.flood = *cfg;
+    _cfg_stg.pending |= CFG_FLOOD;
+    _cfg_mutex.unlock();
+    _post_cfg();
+}
+
+void HeyMacLayer::get_flood_stats(hm_flood_stats_t *r_stats)
+{
+    _flood.get_stats(r_stats);
+}
+
+bool HeyMacLayer::get_ngbr(uint16_t short_addr, hm_ngbr_t *r_ngbr)
+{
+    hm_ngbr_t const *ngbr = _ngbrs.find_short(short_addr);
+
+    if (ngbr != nullptr)
+    {
+        *r_ngbr = *ngbr;
     }
+    return ngbr != nullptr;
+}
+
+uint8_t HeyMacLayer::get_ngbr_cnt(void)
+{
+    return _ngbrs.get_cnt();
+}
+
+bool HeyMacLayer::get_next_hop(uint16_t dst, uint16_t *r_next_hop)
+{
+    return _routes.get_next_hop(dst, r_next_hop);
+}
+
+void HeyMacLayer::get_route_stats(hm_route_stats_t *r_stats)
+{
+    _routes.get_stats(r_stats);
 }
 
 void HeyMacLayer::evt_btn(void)
@@ -166,7 +450,9 @@ void HeyMacLayer::thread_join(void)
 void HeyMacLayer::thread_start(void)
 {
     _thread->start(callback(this, &HeyMacLayer::_main));
-    _thread->flags_set(EVT_THRD_INIT);
+
+    /* Settings staged before the start are applied now */
+    _thread->flags_set(EVT_THRD_INIT | EVT_CFG);
 }
 
 
@@ -201,6 +487,18 @@ void HeyMacLayer::_main(void)
             }
         }
 
+        /* Schedule newly enqueued frames (not meant for state machines) */
+        if (evt_flags & EVT_TX_ENQ)
+        {
+            _drain_tx_ring();
+        }
+
+        /* Apply staged settings (not meant for state machines) */
+        if (evt_flags & EVT_CFG)
+        {
+            _apply_cfg();
+        }
+
         /* Call the state handler with the events */
         retval = (this->*_st_handler)(evt_flags | evt_flag_enter);
 
@@ -220,6 +518,67 @@ void HeyMacLayer::_ticker_clbk(void)
 }
 
 
+uint32_t HeyMacLayer::_now_ms(void)
+{
+    return (uint32_t)Kernel::get_ms_count();
+}
+
+
+void HeyMacLayer::_arm_tx_tmout(void)
+{
+    uint32_t const now_ms = _now_ms();
+
+    uint32_t wake_ms;
+    uint32_t held_until_ms;
+    bool const held = _tx_held(now_ms, &held_until_ms);
+
+    _tx_tmout.detach();
+
+    /* In TDMA mode the slots pace TX, not the frames' times */
+    if (_tdma_on)
+    {
+    }
+    else if (_tx_sched.is_due(now_ms) && !held)
+    {
+        _thread->flags_set(EVT_TX_RDY);
+    }
+    else if (!_tx_sched.is_empty())
+    {
+        /* Wake at the earliest frame's time, but not before a hold ends */
+        wake_ms = _tx_sched.get_next_time();
+        if (held && HeyMacTxSched::is_before(wake_ms, held_until_ms))
+        {
+            wake_ms = held_until_ms;
+        }
+        if (HeyMacTxSched::is_before(wake_ms, now_ms))
+        {
+            wake_ms = now_ms;
+        }
+        /* In 64 bits: a delay over 71 minutes overflows 32 bits of us */
+        _tx_tmout.attach_us(callback(this, &HeyMacLayer::_tx_tmout_clbk),
+                            (uint64_t)(wake_ms - now_ms) * 1000);
+    }
+}
+
+
+void HeyMacLayer::_tx_tmout_clbk(void)
+{
+    _thread->flags_set(EVT_TX_RDY);
+}
+
+
+void HeyMacLayer::_drain_tx_ring(void)
+{
+    HeyMacTxSched::tx_data_t tx_data;
+
+    while (!_tx_sched.is_full() && _tx_ring.pop(&tx_data))
+    {
+        _tx_sched.push(tx_data.frm, tx_data.at_time_ms);
+    }
+    _arm_tx_tmout();
+}
+
+
 HeyMacLayer::sm_ret_t HeyMacLayer::_st_initing(uint32_t const evt_flags)
 {
     sm_ret_t retval = SM_RET_IGNORED;
@@ -286,14 +645,22 @@ HeyMacLayer::sm_ret_t HeyMacLayer::_st_setting(uint32_t const evt_flags)
         _radio->write_op_mode(SX127xRadio::OP_MODE_STBY);
         // TODO: await mode ready?
 
-        /* If there are frames to be transmitted */
-        if (!_tx_queue.empty())
+        _drop_suppressed();
+
+        /* A synced TDMA node works slot by slot; an unsynced one listens */
+        if (_tdma_on && _tdma.is_synced(us_ticker_read()))
         {
-            /* Set DIO to allow TX_DONE interrupt */
-            _radio->set(SX127xRadio::FLD_RDO_DIO0, 1);
+            SM_TRAN(&HeyMacLayer::_st_slotting);
+        }
+
+        /* If a scheduled frame is due and TX is not held off */
+        else if (!_tdma_on && _tx_sched.is_due(_now_ms()) && !_tx_held(_now_ms(), nullptr))
+        {
+            /* Set DIO to allow CAD_DONE interrupt */
+            _radio->set(SX127xRadio::FLD_RDO_DIO0, 2);
             _radio->write_stngs(false);
 
-            SM_TRAN(&HeyMacLayer::_st_txing);
+            SM_TRAN(&HeyMacLayer::_st_cading);
         }
         else
         {
@@ -328,6 +695,9 @@ HeyMacLayer::sm_ret_t HeyMacLayer::_st_lstning(uint32_t const evt_flags)
                             | SX127xRadio::LORA_IRQ_VALID_HEADER));
         _radio->write_fifo_ptr(0x00);
         _radio->write_op_mode(SX127xRadio::OP_MODE_RXCONT);
+
+        /* Wake when the next scheduled frame is due */
+        _arm_tx_tmout();
         SM_HANDLED();
     }
 
@@ -335,6 +705,10 @@ HeyMacLayer::sm_ret_t HeyMacLayer::_st_lstning(uint32_t const evt_flags)
     {
         // TODO: update status, rx meta-data
         _radio->updt_rng();
+        _csma.seed(_radio->get_rng_raw());
+        _flood.seed(_radio->get_rng_raw());
+        _routes.expire(_now_ms(), ROUTE_MAX_AGE_MS);
+        _bcn_prdc();
         SM_HANDLED();
     }
 
@@ -351,20 +725,24 @@ HeyMacLayer::sm_ret_t HeyMacLayer::_st_lstning(uint32_t const evt_flags)
         HeyMacFrame *frm;
         HeyMacCmd cmd;
 
-        _hm_ident->copy_tac_id_into(tac_id);
-        frm = new HeyMacFrame();
-        frm->set_protocol(HM_PIDFLD_CSMA_V0);
-        frm->set_src_addr(_hm_ident->get_long_addr());
-        cmd.cmd_init(frm);
-        cmd.cmd_txt(tac_id, strlen(tac_id));
-        enq_tx_frame(frm);
+        frm = HeyMacFramePool::alloc();
+        if (frm != nullptr)
+        {
+            _hm_ident->copy_tac_id_into(tac_id);
+            frm->set_hdr<HeyMacHdrCsmaLongSrc>(_hm_ident->get_long_addr());
+            cmd.cmd_init(frm);
+            cmd.cmd_txt(tac_id, strlen(tac_id));
+            if (HM_RET_OK != enq_tx_frame(frm))
+            {
+                HeyMacFramePool::release(frm);
+            }
+        }
         SM_HANDLED();
     }
 
+    /* _evt_dio() has stored the timestamp for the incoming frame */
     else if (evt_flags & EVT_DIO_VALID_HDR)
     {
-        // TODO: Store timestamp for the incoming frame
-
         SM_TRAN(&HeyMacLayer::_st_rxing);
     }
 
@@ -381,45 +759,804 @@ HeyMacLayer::sm_ret_t HeyMacLayer::_st_rxing(uint32_t const evt_flags)
 
     else if (evt_flags & EVT_DIO_RX_DONE)
     {
-        // TODO: get frame and meta-data from radio
-
+        _rx_frame();
         SM_TRAN(&HeyMacLayer::_st_setting);
     }
 
     return retval;
 }
 
-HeyMacLayer::sm_ret_t HeyMacLayer::_st_txing(uint32_t const evt_flags)
+HeyMacLayer::sm_ret_t HeyMacLayer::_st_cading(uint32_t const evt_flags)
 {
     sm_ret_t retval = SM_RET_IGNORED;
+    uint32_t backoff_ms;
 
     if (evt_flags & EVT_SM_ENTER)
     {
         _radio->write_lora_irq_mask(
             /* disable_these */ SX127xRadio::LORA_IRQ_ALL,
-            /* enable_these */  SX127xRadio::LORA_IRQ_TX_DONE);
-        _radio->write_lora_irq_flags(SX127xRadio::LORA_IRQ_TX_DONE);
-        _radio->write_fifo_ptr(0x00);
+            /* enable_these */ (SX127xRadio::irq_bitf_t)
+                            ( SX127xRadio::LORA_IRQ_CAD_DONE
+                            | SX127xRadio::LORA_IRQ_CAD_DETECTED));
+        _radio->write_lora_irq_flags((SX127xRadio::irq_bitf_t)
+                            ( SX127xRadio::LORA_IRQ_CAD_DONE
+                            | SX127xRadio::LORA_IRQ_CAD_DETECTED));
+        _radio->write_op_mode(SX127xRadio::OP_MODE_CAD);
+        SM_HANDLED();
+    }
+
+    /* The radio returns to standby after CAD */
+    else if (evt_flags & EVT_DIO_CAD_DONE)
+    {
+        if ((_radio->read_lora_irq_flags() & SX127xRadio::LORA_IRQ_CAD_DETECTED) == 0)
+        {
+            _csma.chnl_clear();
+
+            /* Set DIO to allow TX_DONE interrupt */
+            _radio->set(SX127xRadio::FLD_RDO_DIO0, 1);
+            _radio->write_stngs(false);
+
+            SM_TRAN(&HeyMacLayer::_st_txing);
+        }
+        else
+        {
+            /* Busy: back off (listening meanwhile) or give up on the frame */
+            if (_csma.chnl_busy(&backoff_ms))
+            {
+                _tx_backoff = true;
+                _tx_backoff_until_ms = _now_ms() + backoff_ms;
+            }
+            else
+            {
+                /* Counted in the CSMA drop_cnt, not as a sent frame */
+                HeyMacFramePool::release(_tx_sched.drop());
+                _drain_tx_ring();
+            }
+
+            SM_TRAN(&HeyMacLayer::_st_setting);
+        }
+    }
+
+    return retval;
+}
+
+HeyMacLayer::sm_ret_t HeyMacLayer::_st_slotting(uint32_t const evt_flags)
+{
+    sm_ret_t retval = SM_RET_IGNORED;
+    uint32_t const now_us = us_ticker_read();
+    uint8_t type_mask;
+    uint8_t slot;
+    uint32_t start_us;
+    int32_t wait_us;
+    HeyMacTxSched::tx_data_t tx_data;
+
+    if (evt_flags & EVT_SM_ENTER)
+    {
+        /* TX slots are only of interest when a frame is due */
+        type_mask = (1 << HM_SLOT_RX) | (1 << HM_SLOT_BCN);
+        if (_tx_sched.is_due(_now_ms()))
+        {
+            type_mask |= (1 << HM_SLOT_TX);
+        }
+
+        _slot_type = HM_SLOT_IDLE;
+        if (_tdma.next_slot(now_us + SLOT_LEAD_US, type_mask, &slot, &start_us))
+        {
+            _slot_type = _tdma.get_slot(slot);
+            if (HM_SLOT_BCN == _slot_type)
+            {
+                _tx_frm = _tdma_bcn(start_us);
+            }
+            else if ((HM_SLOT_TX == _slot_type) && _tx_sched.pop_due(_now_ms(), &tx_data))
+            {
+                _tx_frm = tx_data.frm;
+                _drain_tx_ring();
+            }
+
+            /*
+            Load the frame now so only the op mode write is left
+            for the slot start
+            */
+            if (_tx_frm != nullptr)
+            {
+                _radio->set(SX127xRadio::FLD_RDO_DIO0, 1);
+                _radio->write_stngs(false);
+                _radio->write_lora_irq_mask(
+                    /* disable_these */ SX127xRadio::LORA_IRQ_ALL,
+                    /* enable_these */  SX127xRadio::LORA_IRQ_TX_DONE);
+                _radio->write_lora_irq_flags(SX127xRadio::LORA_IRQ_TX_DONE);
+                _radio->write_fifo_ptr(0x00);
+                _radio->write_fifo(_tx_frm->get_buf(), _tx_frm->get_buf_sz());
+                _slot_type = HM_SLOT_TX;
+            }
+            else if (HM_SLOT_RX == _slot_type)
+            {
+                /* Set DIO to allow RxDone, RxTimeout, ValidHeader interrupts */
+                _radio->set(SX127xRadio::FLD_RDO_DIO0, 0);
+                _radio->set(SX127xRadio::FLD_RDO_DIO1, 0);
+                _radio->set(SX127xRadio::FLD_RDO_DIO3, 1);
+                _radio->write_stngs(false);
+                _radio->write_lora_irq_mask(
+                    /* disable_these */ SX127xRadio::LORA_IRQ_ALL,
+                    /* enable_these */ (SX127xRadio::irq_bitf_t)
+                                    ( SX127xRadio::LORA_IRQ_RX_DONE
+                                    | SX127xRadio::LORA_IRQ_PAYLD_CRC_ERR
+                                    | SX127xRadio::LORA_IRQ_VALID_HEADER
+                                    | SX127xRadio::LORA_IRQ_RX_TIMEOUT));
+                _radio->write_lora_irq_flags((SX127xRadio::irq_bitf_t)
+                                    ( SX127xRadio::LORA_IRQ_RX_DONE
+                                    | SX127xRadio::LORA_IRQ_PAYLD_CRC_ERR
+                                    | SX127xRadio::LORA_IRQ_VALID_HEADER
+                                    | SX127xRadio::LORA_IRQ_RX_TIMEOUT));
+                _radio->write_fifo_ptr(0x00);
+            }
+            else
+            {
+                /* No beacon could be made; sit this slot out */
+                _slot_type = HM_SLOT_IDLE;
+            }
+
+            /* If the preparation overran the slot start, start it now */
+            wait_us = (int32_t)(start_us - us_ticker_read());
+            if (wait_us > 0)
+            {
+                _slot_tmout.attach_us(callback(this, &HeyMacLayer::_slot_tmout_clbk), wait_us);
+            }
+            else
+            {
+                _thread->flags_set(EVT_SLOT);
+            }
+            SM_HANDLED();
+        }
+
+        /* Slot 0 is always allocated, so sync was lost; Setting will listen */
+        else
+        {
+            SM_TRAN(&HeyMacLayer::_st_setting);
+        }
+    }
+
+    else if (evt_flags & EVT_SLOT)
+    {
+        if (HM_SLOT_TX == _slot_type)
+        {
+            _radio->write_op_mode(SX127xRadio::OP_MODE_TX);
+            _tdma.count_tx_slot();
+            SM_TRAN(&HeyMacLayer::_st_txing);
+        }
+        else if (HM_SLOT_RX == _slot_type)
+        {
+            _radio->write_op_mode(SX127xRadio::OP_MODE_RXONCE);
+            SM_HANDLED();
+        }
+        else
+        {
+            SM_TRAN(&HeyMacLayer::_st_setting);
+        }
+    }
+
+    /* _evt_dio() has stored the timestamp for the incoming frame */
+    else if (evt_flags & EVT_DIO_VALID_HDR)
+    {
+        _tdma.count_rx_win(true);
+        SM_TRAN(&HeyMacLayer::_st_rxing);
+    }
+
+    /* The radio returns to standby after the RX timeout */
+    else if (evt_flags & EVT_DIO_RX_TMOUT)
+    {
+        _tdma.count_rx_win(false);
+        SM_TRAN(&HeyMacLayer::_st_setting);
+    }
 
-        // TODO: Wrap _tx_queue access with smphr?
-        tx_data_t tx_data = _tx_queue.front();
-        _tx_queue.pop_front();
-        HeyMacFrame *frm = tx_data.frm;
-        _radio->write_fifo(frm->get_buf(), frm->get_buf_sz());
+    /* A member's beacon goes out in one of its TX slots */
+    else if (evt_flags & EVT_THRD_PRDC)
+    {
+        _routes.expire(_now_ms(), ROUTE_MAX_AGE_MS);
+        _bcn_prdc();
+        SM_HANDLED();
+    }
+
+    return retval;
+}
+
+HeyMacLayer::sm_ret_t HeyMacLayer::_st_txing(uint32_t const evt_flags)
+{
+    sm_ret_t retval = SM_RET_IGNORED;
 
-        _radio->write_op_mode(SX127xRadio::OP_MODE_TX);
+    if (evt_flags & EVT_SM_ENTER)
+    {
+        /* In TDMA, Slotting has already started TX at the slot start */
+        if (_tx_frm == nullptr)
+        {
+            _radio->write_lora_irq_mask(
+                /* disable_these */ SX127xRadio::LORA_IRQ_ALL,
+                /* enable_these */  SX127xRadio::LORA_IRQ_TX_DONE);
+            _tx_start();
+        }
         SM_HANDLED();
     }
 
     else if (evt_flags & EVT_DIO_TX_DONE)
     {
-        SM_TRAN(&HeyMacLayer::_st_setting);
+        /* The frame is sent; give it to the hook, then back to the pool */
+        if (_tx_done_clbk)
+        {
+            _tx_done_clbk(_tx_frm);
+        }
+        HeyMacFramePool::release(_tx_frm);
+        _tx_frm = nullptr;
+
+        /*
+        Burst: if another frame is due and no settings changed,
+        send it now; the radio is already in standby after TxDone.
+        Otherwise, go through Setting.
+        */
+        _drop_suppressed();
+        if (!_tdma_on && _tx_sched.is_due(_now_ms()) && !_radio->stngs_outstanding())
+        {
+            _tx_burst_cnt++;
+            _tx_start();
+            SM_HANDLED();
+        }
+        else
+        {
+            SM_TRAN(&HeyMacLayer::_st_setting);
+        }
     }
 
     return retval;
 }
 
 
+void HeyMacLayer::_tx_start(void)
+{
+    HeyMacTxSched::tx_data_t tx_data;
+    bool const due = _tx_sched.pop_due(_now_ms(), &tx_data);
+
+    MBED_ASSERT(due);
+    (void)due;
+    _tx_frm = tx_data.frm;
+
+    /* Make room for any frames that were waiting on a full schedule */
+    _drain_tx_ring();
+
+    _radio->write_lora_irq_flags(SX127xRadio::LORA_IRQ_TX_DONE);
+    _radio->write_fifo_ptr(0x00);
+    _radio->write_fifo(_tx_frm->get_buf(), _tx_frm->get_buf_sz());
+    _radio->write_op_mode(SX127xRadio::OP_MODE_TX);
+}
+
+
+void HeyMacLayer::_post_cfg(void)
+{
+    /* Before thread_start(), the thread cannot take flags */
+    if (_thread->get_state() != Thread::Inactive)
+    {
+        _thread->flags_set(EVT_CFG);
+    }
+}
+
+void HeyMacLayer::_apply_cfg(void)
+{
+    cfg_stg_t stg;
+    uint8_t slot;
+
+    /* Take a consistent copy; the setters only hold the lock to copy in */
+    _cfg_mutex.lock();
+    stg = _cfg_stg;
+    _cfg_stg.pending = 0;
+    _cfg_stg.slots_dirty = 0;
+    _cfg_mutex.unlock();
+
+    if (stg.pending & CFG_CSMA)
+    {
+        _csma.set_cfg(&stg.csma);
+    }
+    if (stg.pending & CFG_TDMA)
+    {
+        _tdma.set_cfg(&stg.tdma);
+    }
+    if (stg.pending & CFG_TDMA_SLOTS)
+    {
+        for (slot = 0; slot < HM_TDMA_SLOT_MAX; slot++)
+        {
+            if (stg.slots_dirty & (1ULL << slot))
+            {
+                _tdma.set_slot(slot, stg.slots[slot]);
+            }
+        }
+    }
+    if (stg.pending & CFG_FLOOD)
+    {
+        _flood.set_cfg(&stg.flood);
+    }
+    if (stg.pending & CFG_RX_FILTER)
+    {
+        _rx_net_id = stg.net_id;
+        _rx_short_addr = stg.short_addr;
+        _routes.set_addr(stg.short_addr);
+    }
+    if (stg.pending & CFG_TDMA_ON)
+    {
+        _tdma.unsync();
+        if (stg.tdma_on && stg.tdma_coord)
+        {
+            _tdma.anchor(us_ticker_read());
+        }
+        _tdma_on = stg.tdma_on;
+
+        /*
+        Leave Lstning so Setting takes the TDMA path
+        or re-arms the CSMA TX timer
+        */
+        _thread->flags_set(EVT_TX_RDY);
+    }
+}
+
+
+void HeyMacLayer::_slot_tmout_clbk(void)
+{
+    _thread->flags_set(EVT_SLOT);
+}
+
+
+HeyMacFrame *HeyMacLayer::_tdma_bcn(uint32_t start_us)
+{
+    HeyMacFrame *frm;
+    HeyMacCmd cmd;
+    hm_cmd_sbcn_t sbcn;
+    uint32_t asn;
+
+    frm = HeyMacFramePool::alloc();
+    if (frm != nullptr)
+    {
+        frm->set_hdr<HeyMacHdrTdmaLongSrc>(_hm_ident->get_long_addr());
+
+        /* The coordinator's neighbors and routes ride along in its beacon */
+        cmd.cmd_init(frm, true);
+        sbcn.dscpln = HM_PIDFLD_TDMA_V0;
+        sbcn.caps = 0xCA; // TODO: impl:
+        sbcn.status = 0x00;
+        sbcn.asn = _tdma.get_asn(start_us);
+        cmd.cmd_sbcn(&sbcn);
+        _bcn_cmds(&cmd);
+
+        /* Receivers sync to the beacon only if they can find its SBCN */
+        if (!_get_tdma_bcn_asn(frm, &asn) || (asn != sbcn.asn))
+        {
+            MBED_ASSERT(false);
+            HeyMacFramePool::release(frm);
+            frm = nullptr;
+        }
+    }
+    return frm;
+}
+
+bool HeyMacLayer::_get_tdma_bcn_asn(HeyMacFrame *frm, uint32_t *r_asn)
+{
+    bool found = false;
+    hm_cmd_t cmd;
+
+    if ((frm->get_frm()[FRM_IDX_PID] == HM_PIDFLD_TDMA_V0)
+     && HeyMacCmd::find(frm->get_payld(), frm->get_payld_sz(), HM_CID_SBCN, &cmd))
+    {
+        *r_asn = cmd.sbcn.asn;
+        found = true;
+    }
+    return found;
+}
+
+
+void HeyMacLayer::_rx_frame(void)
+{
+    SX127xRadio::rx_info_t info;
+    hm_rx_rec_t rec;
+    uint32_t asn;
+    HeyMacFrame *frm = nullptr;
+    uint8_t *buf;
+    uint8_t hdr_sz;
+    uint8_t save;
+
+    if (_radio->read_lora_irq_flags() & SX127xRadio::LORA_IRQ_PAYLD_CRC_ERR)
+    {
+        _rx_stats.crc_err_cnt++;
+    }
+    else
+    {
+        _radio->read_rx_info(&info);
+        frm = HeyMacFramePool::alloc(info.sz);
+        if (frm == nullptr)
+        {
+            _rx_stats.no_frm_cnt++;
+        }
+    }
+
+    /* Read just the header and drop the frame early if it is not for us */
+    if (frm != nullptr)
+    {
+        buf = frm->get_buf();
+        hdr_sz = (info.sz < RX_HDR_PEEK_SZ) ? info.sz : RX_HDR_PEEK_SZ;
+        _radio->read_fifo(buf, info.fifo_addr, 1 + hdr_sz);
+        _rx_stats.rx_cnt++;
+
+        if (!_rx_hdr_wanted(&buf[1], hdr_sz))
+        {
+            /* Not for us, but its sender is still a neighbor */
+            _ngbr_rx_hdr(&buf[1], hdr_sz, &info);
+            _rx_stats.early_drop_cnt++;
+            _rx_stats.spi_octets_saved += info.sz - hdr_sz;
+            HeyMacFramePool::release(frm);
+            frm = nullptr;
+        }
+
+        /*
+        Read the rest in one SPI burst straight into the pool buffer.
+        read_fifo() puts the SPI command in the octet before the data,
+        which is the header's last octet, so put that octet back.
+        */
+        else if (info.sz > hdr_sz)
+        {
+            save = buf[hdr_sz];
+            _radio->read_fifo(&buf[hdr_sz], info.fifo_addr + hdr_sz, 1 + info.sz - hdr_sz);
+            buf[hdr_sz] = save;
+        }
+    }
+
+    if (frm != nullptr)
+    {
+        /* Parsed once; the helpers below share the view */
+        HeyMacFrameView view(frm->get_frm(), info.sz);
+
+        /* eXtended frames skip the HeyMac header parsing */
+        if (_ext.dispatch(frm->get_frm(), info.sz))
+        {
+            _rx_stats.ext_cnt++;
+            HeyMacFramePool::release(frm);
+        }
+        else if (!frm->parse(&view))
+        {
+            _rx_stats.parse_err_cnt++;
+            HeyMacFramePool::release(frm);
+        }
+        else
+        {
+            /* Every frame heard, even a flood duplicate, tells of a link */
+            _ngbr_rx(view, &info);
+
+            if (_flood_rx(frm, view))
+            {
+                HeyMacFramePool::release(frm);
+            }
+            else if (_route_rx(frm, view))
+            {
+                /* Relayed or not ours; _route_rx() took the frame */
+            }
+            else
+            {
+                /* Keep listening if the sender says another frame follows */
+                _rx_hold = frm->is_pending();
+                _rx_hold_until_ms = _now_ms() + RX_HOLD_MS;
+
+                /* A TDMA beacon anchors the superframe */
+                if (_tdma_on && _get_tdma_bcn_asn(frm, &asn))
+                {
+                    _tdma.sync(_rx_hdr_us, asn);
+                }
+
+                _cmd_dispatch.dispatch(frm->get_payld(), frm->get_payld_sz());
+
+                rec.frm = frm;
+                rec.hdr_us = _rx_hdr_us;
+                rec.rssi_dbm = info.rssi_dbm;
+                rec.snr_qdb = info.snr_qdb;
+                if (_rx_queue.put(&rec))
+                {
+                    if (_rx_clbk)
+                    {
+                        _rx_clbk();
+                    }
+                }
+                else
+                {
+                    _rx_stats.queue_full_cnt++;
+                    HeyMacFramePool::release(frm);
+                }
+            }
+        }
+    }
+}
+
+
+bool HeyMacLayer::_rx_hdr_wanted(uint8_t const *hdr, uint8_t sz)
+{
+    bool wanted = true;
+    uint8_t fctl;
+    uint8_t offset = FRM_IDX_NETID;
+    uint16_t net_id;
+    uint16_t dst_short;
+    uint64_t dst_long;
+
+    /* eXtended frames go to their handlers unfiltered */
+    if ((sz > FRM_IDX_FCTL) && ((hdr[FRM_IDX_FCTL] & FCTL_BIT_X) == 0))
+    {
+        fctl = hdr[FRM_IDX_FCTL];
+        wanted = (hdr[FRM_IDX_PID] == HM_PIDFLD_CSMA_V0)
+              || (hdr[FRM_IDX_PID] == HM_PIDFLD_TDMA_V0)
+              || (hdr[FRM_IDX_PID] == HM_PIDFLD_FLOOD);
+
+        if (wanted && (fctl & FCTL_BIT_N) && (offset + 2 <= sz))
+        {
+            net_id = be16_ld(&hdr[offset]);
+            wanted = (_rx_net_id == 0) || (net_id == _rx_net_id);
+        }
+        if (fctl & FCTL_BIT_N)
+        {
+            offset += 2;
+        }
+
+        /* Multihop frames may need to be relayed, so keep them */
+        if (wanted && (fctl & FCTL_BIT_D) && !(fctl & FCTL_BIT_M))
+        {
+            if ((fctl & FCTL_BIT_L) && (offset + 8 <= sz))
+            {
+                dst_long = be64_ld(&hdr[offset]);
+                wanted = (dst_long == HM_ADDR_LONG_BCAST)
+                      || (dst_long == _hm_ident->get_long_addr());
+            }
+            else if (!(fctl & FCTL_BIT_L) && (offset + 2 <= sz))
+            {
+                dst_short = be16_ld(&hdr[offset]);
+                wanted = (dst_short == HM_ADDR_SHORT_BCAST)
+                      || ((_rx_short_addr != 0) && (dst_short == _rx_short_addr));
+            }
+        }
+    }
+    return wanted;
+}
+
+
+void HeyMacLayer::_ngbr_rx(HeyMacFrameView const &view, SX127xRadio::rx_info_t const *info)
+{
+    uint16_t short_addr = 0;
+    uint64_t long_addr = 0;
+    uint32_t seq = 0;
+    bool has_seq = false;
+
+    /*
+    The neighbor is the last hop: TxAddr of a flood frame,
+    or SrcAddr of a single-hop frame, whose sequence numbers
+    then show lost frames.  A routed frame's TxAddr is its next hop,
+    so it does not tell who sent it.
+    */
+    if (view.is_mhop() && (view.get_pid() == HM_PIDFLD_FLOOD))
+    {
+        short_addr = view.is_long_addr() ? 0 : view.get_tx_addr_short();
+        long_addr = view.is_long_addr() ? view.get_tx_addr_long() : 0;
+    }
+    else if (!view.is_mhop() && view.has_src_addr())
+    {
+        short_addr = view.is_long_addr() ? 0 : view.get_src_addr_short();
+        long_addr = view.is_long_addr() ? view.get_src_addr_long() : 0;
+        has_seq = HeyMacIe::get_seq(view.get_ies(), view.get_ie_sz(), &seq);
+    }
+    _rx_ngbr = _ngbrs.heard(short_addr, long_addr, info->rssi_dbm, info->snr_qdb,
+                 _now_ms(), has_seq, seq);
+}
+
+
+void HeyMacLayer::_ngbr_rx_hdr(uint8_t const *hdr, uint8_t sz, SX127xRadio::rx_info_t const *info)
+{
+    bool ok;
+    uint8_t fctl;
+    uint8_t addr_sz;
+    uint8_t ie_sz;
+    uint8_t mic_sz;
+    uint16_t offset = FRM_IDX_NETID;
+    uint32_t seq = 0;
+    bool has_seq = false;
+
+    /*
+    Walk the header as far as SrcAddr.  The filter only drops
+    single-hop frames early, so SrcAddr is the last hop.
+    Senders in other networks are not counted as neighbors.
+    */
+    ok = (sz > FRM_IDX_FCTL)
+      && ((hdr[FRM_IDX_FCTL] & (FCTL_BIT_X | FCTL_BIT_M | FCTL_BIT_S)) == FCTL_BIT_S)
+      && ((hdr[FRM_IDX_PID] == HM_PIDFLD_CSMA_V0) || (hdr[FRM_IDX_PID] == HM_PIDFLD_TDMA_V0));
+    if (ok)
+    {
+        fctl = hdr[FRM_IDX_FCTL];
+        addr_sz = (fctl & FCTL_BIT_L) ? 8 : 2;
+        if (fctl & FCTL_BIT_N)
+        {
+            ok = (offset + 2 <= sz)
+              && ((_rx_net_id == 0) || (be16_ld(&hdr[offset]) == _rx_net_id));
+            offset += 2;
+        }
+        if (fctl & FCTL_BIT_D)
+        {
+            offset += addr_sz;
+        }
+        if (ok && (fctl & FCTL_BIT_I))
+        {
+            ie_sz = (offset < sz) ? HeyMacIe::scan(&hdr[offset], sz - offset, &mic_sz) : 0;
+            ok = (ie_sz > 0);
+            if (ok)
+            {
+                has_seq = HeyMacIe::get_seq(&hdr[offset], ie_sz, &seq);
+            }
+            offset += ie_sz;
+        }
+        if (ok && (offset + addr_sz <= sz))
+        {
+            _ngbrs.heard((fctl & FCTL_BIT_L) ? 0 : be16_ld(&hdr[offset]),
+                         (fctl & FCTL_BIT_L) ? be64_ld(&hdr[offset]) : 0,
+                         info->rssi_dbm, info->snr_qdb, _now_ms(), has_seq, seq);
+        }
+    }
+}
+
+
+bool HeyMacLayer::_route_rx(HeyMacFrame *frm, HeyMacFrameView const &view)
+{
+    bool taken = false;
+    uint16_t dst;
+    uint16_t next_hop;
+
+    if ((_rx_short_addr != 0)
+     && view.is_mhop()
+     && !view.is_long_addr()
+     && view.has_dst_addr()
+     && (view.get_pid() != HM_PIDFLD_FLOOD))
+    {
+        dst = view.get_dst_addr_short();
+        if ((dst != _rx_short_addr) && (dst != HM_ADDR_SHORT_BCAST))
+        {
+            taken = true;
+
+            /* We are its next hop: one lookup and rewrite TxAddr in place */
+            if ((view.get_tx_addr_short() == _rx_short_addr)
+             && _routes.get_next_hop(dst, &next_hop)
+             && frm->updt_mhop(next_hop)
+             && (HM_RET_OK == enq_tx_frame(frm)))
+            {
+                _routes.count_fwd();
+            }
+
+            /* Overheard, out of hops, no route or no room */
+            else
+            {
+                HeyMacFramePool::release(frm);
+            }
+        }
+    }
+    return taken;
+}
+
+
+void HeyMacLayer::_cbcn_hndlr(hm_cmd_t const *cmd)
+{
+    if (_rx_ngbr != nullptr)
+    {
+        _ngbrs.cbcn_rx(_rx_ngbr, &cmd->cbcn, _rx_short_addr);
+    }
+}
+
+void HeyMacLayer::_rte_hndlr(hm_cmd_t const *cmd)
+{
+    uint8_t lq = RTE_LQ_UNKNOWN;
+
+    /* Beacons have a long SrcAddr; the RTE gives the sender's short one */
+    if (_rx_ngbr != nullptr)
+    {
+        _ngbrs.set_short_addr(_rx_ngbr, cmd->rte.src);
+
+        /* The link cost comes from the sender's link quality, both ways */
+        lq = HeyMacNgbrTbl::get_link_lq(_rx_ngbr);
+    }
+
+    /* A sender that does not hear us cannot be our next hop */
+    if (lq > 0)
+    {
+        _routes.adv_rx(&cmd->rte, HeyMacRoute::link_cost(lq), _now_ms());
+    }
+}
+
+
+bool HeyMacLayer::_flood_rx(HeyMacFrame *frm, HeyMacFrameView const &view)
+{
+    bool drop = false;
+    uint64_t src;
+    bool is_long;
+    uint32_t seq;
+    HeyMacFrame *relay;
+
+    if (HeyMacFlood::get_key(view, &src, &is_long, &seq))
+    {
+        /* Our own frame echoed back, or a copy we have already heard */
+        if ((_flood.heard(src, is_long, seq) > 1)
+         || (is_long && (src == _hm_ident->get_long_addr()))
+         || (!is_long && (_rx_short_addr != 0) && (src == _rx_short_addr)))
+        {
+            drop = true;
+        }
+
+        /*
+        Relay a copy (the upper layer gets the original)
+        after a random jitter so neighbors do not collide.
+        updt_mhop() fails if the hop limit is used up.
+        A short-address frame is not relayed until this node has
+        a short address to put in its TxAddr.
+        */
+        else if (is_long || (_rx_short_addr != 0))
+        {
+            relay = HeyMacFramePool::alloc(frm->get_frm_sz());
+            if (relay != nullptr)
+            {
+                memcpy(relay->get_buf(), frm->get_buf(), frm->get_buf_sz());
+                if (!relay->parse()
+                 || !(is_long ? relay->updt_mhop(_hm_ident->get_long_addr())
+                              : relay->updt_mhop(_rx_short_addr))
+                 || (HM_RET_OK != enq_tx_frame(relay, _now_ms() + _flood.relay_jitter_ms())))
+                {
+                    HeyMacFramePool::release(relay);
+                }
+            }
+        }
+    }
+    return drop;
+}
+
+
+void HeyMacLayer::_drop_suppressed(void)
+{
+    bool dropped = false;
+
+    /* is_suppressed() counts these; they are not counted as sent */
+    while (_tx_sched.is_due(_now_ms()) && _flood.is_suppressed(_tx_sched.get_next_frm()))
+    {
+        HeyMacFramePool::release(_tx_sched.drop());
+        dropped = true;
+    }
+    if (dropped)
+    {
+        _drain_tx_ring();
+    }
+}
+
+
+bool HeyMacLayer::_tx_held(uint32_t now_ms, uint32_t *r_until_ms)
+{
+    uint32_t until_ms = now_ms;
+
+    /* Expire the holds that have ended */
+    if (_rx_hold && !HeyMacTxSched::is_before(now_ms, _rx_hold_until_ms))
+    {
+        _rx_hold = false;
+    }
+    if (_tx_backoff && !HeyMacTxSched::is_before(now_ms, _tx_backoff_until_ms))
+    {
+        _tx_backoff = false;
+    }
+
+    /* Report when the later hold ends */
+    if (_rx_hold)
+    {
+        until_ms = _rx_hold_until_ms;
+    }
+    if (_tx_backoff && HeyMacTxSched::is_before(until_ms, _tx_backoff_until_ms))
+    {
+        until_ms = _tx_backoff_until_ms;
+    }
+    if (r_until_ms)
+    {
+        *r_until_ms = until_ms;
+    }
+    return _rx_hold || _tx_backoff;
+}
+
+
 /* Handler for the SX127xRadio callback for DIO signals */
 void HeyMacLayer::_evt_dio(SX127xRadio::sig_dio_t const sig_dio)
 {
@@ -440,6 +1577,12 @@ void HeyMacLayer::_evt_dio(SX127xRadio::sig_dio_t const sig_dio)
 
     MBED_ASSERT(sig_dio < SX127xRadio::SIG_DIO_CNT);
 
+    /* Timestamp the incoming frame as close to its header as we can */
+    if (SX127xRadio::SIG_DIO_VALID_HDR == sig_dio)
+    {
+        _rx_hdr_us = us_ticker_read();
+    }
+
     /*
     Convert a DIO signal to an application event flag
     and post the flag to this thread
@@ -448,18 +1591,62 @@ void HeyMacLayer::_evt_dio(SX127xRadio::sig_dio_t const sig_dio)
 }
 
 
+void HeyMacLayer::_bcn_prdc(void)
+{
+    uint32_t const now_ms = _now_ms();
+
+    /*
+    A TDMA coordinator beacons in slot 0 instead;
+    an unsynced member has no slot to send in
+    */
+    if (!HeyMacTxSched::is_before(now_ms, _bcn_next_ms)
+     && !(_tdma_on && ((_tdma.get_slot(HM_TDMA_BCN_SLOT) == HM_SLOT_BCN)
+                     || !_tdma.is_synced(us_ticker_read()))))
+    {
+        _tx_bcn();
+        _bcn_next_ms = now_ms + BCN_PRDC_MS - BCN_JITTER_MS / 2
+                     + _radio->get_rng_raw() % BCN_JITTER_MS;
+    }
+}
+
+void HeyMacLayer::_bcn_cmds(HeyMacCmd *cmd)
+{
+    hm_cbcn_ngbr_t ngbrs[HM_NGBR_CNT];
+    hm_cbcn_lists_t lists;
+    hm_rte_adv_t rtes[HM_ROUTE_CNT];
+    uint8_t rte_cnt;
+    uint16_t const caps = 0xCA; // TODO: impl:
+    uint16_t const status = 0x00; // status = red flags = (1==fault)
+
+    /* Recent neighbors: a full list or the changes since our last beacon */
+    lists.nets = nullptr; // TODO: nets
+    lists.net_cnt = 0;
+    _ngbrs.get_cbcn_lists(&lists, ngbrs, _now_ms(), NGBR_MAX_AGE_MS);
+    cmd->cmd_cbcn(caps, status, &lists);
+    if (_rx_short_addr != 0)
+    {
+        rte_cnt = _routes.get_adv(rtes, HM_ROUTE_CNT);
+        cmd->cmd_rte(_rx_short_addr, rtes, rte_cnt);
+    }
+}
+
 void HeyMacLayer::_tx_bcn(void)
 {
     HeyMacFrame *frm;
     HeyMacCmd cmd;
 
-    frm = new HeyMacFrame();
-    frm->set_protocol(HM_PIDFLD_CSMA_V0);
-    frm->set_src_addr(_hm_ident->get_long_addr());
-    cmd.cmd_init(frm);
-    uint16_t const caps = 0xCA; // TODO: impl:
-    uint16_t const status = 0x00; // status = red flags = (1==fault)
-    cmd.cmd_cbcn(caps, status);   //TODO: , nets, ngbrs);
-    enq_tx_frame(frm);
+    frm = HeyMacFramePool::alloc();
+    if (frm != nullptr)
+    {
+        frm->set_hdr<HeyMacHdrCsmaLongSrc>(_hm_ident->get_long_addr());
+
+        /* With a short address, our routes ride along in the same frame */
+        cmd.cmd_init(frm, _rx_short_addr != 0);
+        _bcn_cmds(&cmd);
+        if (HM_RET_OK != enq_tx_frame(frm))
+        {
+            HeyMacFramePool::release(frm);
+        }
+    }
 }
 
@@ -11,10 +11,35 @@
 #include "SX127xRadio.h"
 #include "HeyMacIdent.h"
 #include "HeyMacFrame.h"
+#include "HeyMacFrameView.h"
+#include "HeyMacExt.h"
+#include "HeyMacCmd.h"
+#include "HeyMacTxSched.h"
+#include "HeyMacTxRing.h"
+#include "HeyMacRxQueue.h"
+#include "HeyMacCsma.h"
+#include "HeyMacTdma.h"
+#include "HeyMacFlood.h"
+#include "HeyMacNgbrTbl.h"
+#include "HeyMacRoute.h"
 
 using namespace std;
 
 
+/** Receive statistics */
+typedef struct
+{
+    uint32_t rx_cnt;            /* frames read from the radio */
+    uint32_t crc_err_cnt;       /* frames dropped for a bad CRC */
+    uint32_t no_frm_cnt;        /* frames dropped because the pool was empty */
+    uint32_t parse_err_cnt;     /* frames dropped because they did not parse */
+    uint32_t ext_cnt;           /* eXtended frames given to a handler */
+    uint32_t queue_full_cnt;    /* frames dropped because the RX queue was full */
+    uint32_t early_drop_cnt;    /* frames dropped by the header filters */
+    uint32_t spi_octets_saved;  /* FIFO octets not read because of early drops */
+} hm_rx_stats_t;
+
+
 class HeyMacLayer
 {
 public:
@@ -22,11 +47,156 @@ public:
     ~HeyMacLayer();
 
     /**
-     * Enqueue a frame into the transmit queue
-     * TODO: to transmit at the given time (tx_time == 0 means ASAP)
-     * and signal the state machine.
+     * Enqueue a frame to transmit at the given time (tx_time == 0 means ASAP)
+     * and signal the state machine, which moves it into the transmit schedule.
+     * tx_time is in milliseconds of the kernel clock (truncated to 32 bits).
+     * Lock-free; may be called from any thread or ISR.
+     *
+     * The frame MUST come from HeyMacFramePool.  On HM_RET_OK, this layer
+     * takes the caller's reference and releases it after the frame is sent.
+     * Returns HM_RET_FULL if HM_TX_QUEUE_CNT frames are already waiting
+     * to be scheduled; the caller then keeps its reference.
+     */
+    hm_retval_t enq_tx_frame(HeyMacFrame *frm, uint32_t tx_time = 0/*ASAP*/ /*TODO: ,tx_stngs*/);
+
+    /**
+     * Sets a callback that is called in this layer's thread
+     * after each frame is transmitted and before the layer releases it.
+     * To keep the frame, the callback must take a reference
+     * with HeyMacFramePool::ref().
+     * A frame dropped after too many busy CADs is never sent, so it is
+     * released without this callback and counted in get_csma_stats().
+     *
+     * This thread reads the handlers and callbacks without a lock,
+     * so this and the other set_*_clbk(), *_ext_hndlr() and *_cmd_hndlr()
+     * calls MUST be made before thread_start().
+     */
+    void set_tx_done_clbk(Callback<void(HeyMacFrame *)> tx_done_clbk);
+
+    /** Copies how late the scheduled frames went out into r_stats */
+    void get_tx_stats(hm_tx_sched_stats_t *r_stats);
+
+    /** Returns the number of enq_tx_frame() calls that returned HM_RET_FULL */
+    uint32_t get_tx_enq_fail_cnt(void);
+
+    /** Returns the number of frames sent in a burst (without a Setting pass) */
+    uint32_t get_tx_burst_cnt(void);
+
+    /**
+     * Registers the handler for received eXtended frames of the given type.
+     * The handler runs in this layer's thread.
+     * Returns false if no handler slots are free.
+     * MUST be called before thread_start().
+     */
+    bool set_ext_hndlr(uint8_t ext_type, HeyMacExt::hndlr_t hndlr);
+
+    /** Unregisters the handler for eXtended frames of the given type; before thread_start() */
+    void clr_ext_hndlr(uint8_t ext_type);
+
+    /**
+     * Registers the handler for received commands with the given CID.
+     * The handler runs in this layer's thread.
+     * HM_CID_CBCN and HM_CID_RTE are handled by this layer's neighbor
+     * and routing tables; replacing their handlers disables those.
+     * MUST be called before thread_start().
+     */
+    void set_cmd_hndlr(hm_cid_t8 cid, HeyMacCmdDispatch::hndlr_t hndlr);
+
+    /** Unregisters the handler for commands with the given CID; before thread_start() */
+    void clr_cmd_hndlr(hm_cid_t8 cid);
+
+    /**
+     * Returns true and fills r_rec with the oldest received frame
+     * and its meta-data, or false if none are waiting.
+     * The caller MUST release r_rec->frm to HeyMacFramePool when done.
+     * Must be called from only one thread.
+     */
+    bool get_rx_rec(hm_rx_rec_t *r_rec);
+
+    /**
+     * Sets a callback that is called in this layer's thread
+     * each time a received frame is put in the RX queue.
+     * Use it to signal the thread that calls get_rx_rec().
+     * MUST be called before thread_start().
+     */
+    void set_rx_clbk(Callback<void()> rx_clbk);
+
+    /** Copies the receive statistics into r_stats */
+    void get_rx_stats(hm_rx_stats_t *r_stats);
+
+    /*
+     * The set_*() and tdma_*() calls below may be made from any thread
+     * (not from an ISR).  They take effect in this layer's thread
+     * soon after.
      */
-    void enq_tx_frame(HeyMacFrame *frm, uint32_t tx_time = 0/*ASAP*/ /*TODO: ,tx_stngs*/);
+
+    /**
+     * Sets the receive filters that are applied to the first octets
+     * of a frame before the rest is read from the radio.
+     * A frame with a NetId other than net_id is dropped (net_id 0 accepts any).
+     * A frame with a DstAddr other than ours or broadcast is dropped,
+     * unless it is multihop.  short_addr 0 means we have no short address.
+     */
+    void set_rx_filter(uint16_t net_id, uint16_t short_addr);
+
+    /** Sets the CSMA backoff and retry limits */
+    void set_csma_cfg(hm_csma_cfg_t const *cfg);
+
+    /** Copies the CSMA (CAD and backoff) statistics into r_stats */
+    void get_csma_stats(hm_csma_stats_t *r_stats);
+
+    /** Sets the TDMA superframe shape (loses sync) */
+    void set_tdma_cfg(hm_tdma_cfg_t const *cfg);
+
+    /** Allocates a TDMA slot to TX, RX or idle */
+    void set_tdma_slot(uint8_t slot, hm_slot_t8 type);
+
+    /**
+     * Switches the MAC to TDMA.
+     * The coordinator starts the superframe and sends the beacons;
+     * a member listens continuously until it hears a beacon,
+     * then transmits and receives only in its allocated slots.
+     * Frames given to enq_tx_frame() go out in the next TX slot
+     * after their tx_time.
+     */
+    void tdma_start(bool is_coord);
+
+    /** Switches the MAC back to CSMA */
+    void tdma_stop(void);
+
+    /** Copies the TDMA (sync and slot) statistics into r_stats */
+    void get_tdma_stats(hm_tdma_stats_t *r_stats);
+
+    /**
+     * Sets the flood relay jitter and copy-count suppression.
+     * To originate a flood, build a frame with the FLOOD PID,
+     * an HM_IE_SEQ that is new for this source, a SrcAddr
+     * and set_mhop(hop limit, our address), then enq_tx_frame() it.
+     */
+    void set_flood_cfg(hm_flood_cfg_t const *cfg);
+
+    /** Copies the flood (duplicate and relay) statistics into r_stats */
+    void get_flood_stats(hm_flood_stats_t *r_stats);
+
+    /**
+     * Returns true and copies the neighbor with the given short address
+     * into r_ngbr, or returns false if it is not in the neighbor table
+     */
+    bool get_ngbr(uint16_t short_addr, hm_ngbr_t *r_ngbr);
+
+    /** Returns the number of neighbors in the neighbor table */
+    uint8_t get_ngbr_cnt(void);
+
+    /**
+     * Returns true and fills r_next_hop with the next hop to dst.
+     * To send a routed frame, build it with a short DstAddr
+     * and set_mhop(hop limit, next hop), then enq_tx_frame() it;
+     * each relay looks up its own next hop and rewrites TxAddr.
+     */
+    bool get_next_hop(uint16_t dst, uint16_t *r_next_hop);
+
+    /** Copies the routing (lookup and relay) statistics into r_stats */
+    void get_route_stats(hm_route_stats_t *r_stats);
 
     /**
      * Posts an event to this thread indicating a button press.
@@ -50,14 +220,6 @@ private:
         SM_RET_TRAN
     } sm_ret_t;
 
-    /** Transmit data struct that is stored in the _tx_queue */
-    typedef struct
-    {
-        HeyMacFrame *frm;
-        uint32_t at_time_ms;
-        // TODO: tx_stngs;
-    } tx_data_t;
-
     /* Thread stuff */
     Thread *_thread;
     LowPowerTicker *_ticker;
@@ -70,7 +232,104 @@ private:
     SPI *_spi;
     SX127xRadio *_radio;
     HeyMacIdent *_hm_ident;
-    deque<tx_data_t> _tx_queue;
+    /**
+     * Frames go from enq_tx_frame() into the lock-free _tx_ring
+     * and this thread moves them into _tx_sched,
+     * so only this thread touches the schedule and its timer.
+     */
+    HeyMacTxRing _tx_ring;
+    HeyMacTxSched _tx_sched;
+
+    /** Posts EVT_TX_RDY when the earliest scheduled frame is due */
+    LowPowerTimeout _tx_tmout;
+
+    /** The frame being transmitted; owned by this layer until TxDone */
+    HeyMacFrame *_tx_frm;
+    Callback<void(HeyMacFrame *)> _tx_done_clbk;
+    uint32_t _tx_burst_cnt;
+
+    /** Handlers for received eXtended frames */
+    HeyMacExt _ext;
+
+    /** Received frames for the upper layer */
+    HeyMacRxQueue _rx_queue;
+    Callback<void()> _rx_clbk;
+    hm_rx_stats_t _rx_stats;
+
+    /** us_ticker time of the last ValidHeader signal (written in ISR) */
+    volatile uint32_t _rx_hdr_us;
+
+    /**
+     * After a frame with FCTL.P set, TX waits until this time
+     * so the radio keeps listening for the frame that follows
+     */
+    bool _rx_hold;
+    uint32_t _rx_hold_until_ms;
+
+    /* Receive filters */
+    uint16_t _rx_net_id;
+    uint16_t _rx_short_addr;
+
+    /** Listen-before-talk; TX waits until the backoff time after a busy CAD */
+    HeyMacCsma _csma;
+    bool _tx_backoff;
+    uint32_t _tx_backoff_until_ms;
+
+    /**
+     * The TDMA slot schedule.  _slot_tmout is a us_ticker timeout
+     * (the same clock as _rx_hdr_us) that posts EVT_SLOT at a slot start;
+     * _slot_type is what Slotting prepared the radio for.
+     */
+    HeyMacTdma _tdma;
+    bool _tdma_on;
+    Timeout _slot_tmout;
+    hm_slot_t8 _slot_type;
+
+    /** Flood duplicate cache and relay rules */
+    HeyMacFlood _flood;
+
+    /** The nodes heard directly, updated by every received frame */
+    HeyMacNgbrTbl _ngbrs;
+
+    /** The entry of the received frame's sender, while it is processed */
+    hm_ngbr_t const *_rx_ngbr;
+
+    /** Next hops for routed multihop frames */
+    HeyMacRoute _routes;
+
+    /** Handlers for received commands */
+    HeyMacCmdDispatch _cmd_dispatch;
+
+    /** When the next periodic beacon is due */
+    uint32_t _bcn_next_ms;
+
+    /**
+     * Settings from the set_*() and tdma_*() calls, which may come
+     * from any thread.  They are staged here under _cfg_mutex and
+     * EVT_CFG has this thread apply them, so only this thread
+     * touches the live settings.  pending holds CFG_* bits.
+     */
+    typedef struct
+    {
+        uint32_t pending;
+        hm_csma_cfg_t csma;
+        hm_tdma_cfg_t tdma;
+        hm_slot_t8 slots[HM_TDMA_SLOT_MAX];
+        uint64_t slots_dirty;   /* bit n: slots[n] was set */
+        bool tdma_on;
+        bool tdma_coord;
+        hm_flood_cfg_t flood;
+        uint16_t net_id;
+        uint16_t short_addr;
+    } cfg_stg_t;
+    Mutex _cfg_mutex;
+    cfg_stg_t _cfg_stg;
+
+    /** Posts EVT_CFG once the thread has started */
+    void _post_cfg(void);
+
+    /** Applies the staged settings in this thread */
+    void _apply_cfg(void);
 
     /** Runs this thread's main loop */
     void _main(void);
@@ -96,17 +355,18 @@ private:
      * Commands the radio to sleep if there are
      * outstanding settings that need sleep mode.
      * Enters Standby mode and transitions to
-     * Listening or Transmitting if the TX queue is not empty.
+     * Listening or Transmitting if a scheduled frame is due.
      */
     sm_ret_t _st_setting(uint32_t const evt_flags);
 
     /**
      * Listening state
      * Prepares the radio to receive.
-     * Commands the radio to receive-continuous mode.
+     * Commands the radio to receive-continuous mode
+     * and arms the timer for the next scheduled frame.
      * Handles the thread-periodic event
      * and updates radio state info.
-     * If the TX queue is not empty, transitions to Setting.
+     * When a scheduled frame is due, transitions to Setting.
      * Handles the radio-valid-header event
      * and transitions to Receiving.
      */
@@ -117,21 +377,140 @@ private:
      * Handles the radio-receive-done event,
      * reads radio frame and reception meta-data,
      * processes the frame and transitions to Setting.
+     * If the frame has FCTL.P set, holds off TX for a while
+     * so the following frame can be received.
      */
     sm_ret_t _st_rxing(uint32_t const evt_flags);
 
+    /**
+     * CAD state
+     * Performs Channel Activity Detection.
+     * Handles the CAD-done event:
+     * If the channel is clear, transitions to Transmitting.
+     * If it is busy, starts a random backoff, or drops the frame
+     * if the retries are used up, and transitions to Setting.
+     */
+    sm_ret_t _st_cading(uint32_t const evt_flags);
+
+    /**
+     * Slotting state (TDMA only)
+     * Finds the next TX slot with a due frame, the next beacon slot
+     * (coordinator) or the next RX slot, whichever comes first,
+     * prepares the radio for it in standby and arms the slot timer.
+     * Handles the slot-start event:
+     * starts TX and transitions to Transmitting,
+     * or opens a single receive window.
+     * Handles the radio-valid-header event and transitions to Receiving;
+     * handles the radio-receive-timeout event and transitions to Setting.
+     */
+    sm_ret_t _st_slotting(uint32_t const evt_flags);
+
     /**
      * Transmit state
-     * Prepares the radio to transmit.
+     * Prepares the radio to transmit the earliest due frame
+     * (unless Slotting has already started the transmission).
      * Commands the radio to transmit mode.
-     * Handles the radio-transmit-done event
-     * and transitions to Setting.
+     * Handles the radio-transmit-done event,
+     * returns the frame to the pool,
+     * then transmits the next due frame if the radio settings
+     * are unchanged, or transitions to Setting.
      */
     sm_ret_t _st_txing(uint32_t const evt_flags);
 
     /** Ticker callback.  Posts the periodic event to thread */
     void _ticker_clbk(void);
 
+    /** Returns the kernel time in milliseconds, truncated to 32 bits */
+    static uint32_t _now_ms(void);
+
+    /**
+     * Posts EVT_TX_RDY now if a frame is due;
+     * otherwise arms _tx_tmout for the earliest frame.
+     */
+    void _arm_tx_tmout(void);
+
+    /** Timeout callback.  Posts the TX ready event to thread */
+    void _tx_tmout_clbk(void);
+
+    /** Moves frames from _tx_ring into _tx_sched while there is room */
+    void _drain_tx_ring(void);
+
+    /** Pops the earliest due frame, loads it into the FIFO and starts TX */
+    void _tx_start(void);
+
+    /** Timeout callback.  Posts the slot start event to thread */
+    void _slot_tmout_clbk(void);
+
+    /**
+     * Returns a TDMA beacon for the slot that starts at start_us
+     * or nullptr if the pool is empty
+     */
+    HeyMacFrame *_tdma_bcn(uint32_t start_us);
+
+    /**
+     * Returns true if frm is a TDMA beacon (an SBCN, alone or aggregated)
+     * and fills r_asn with its absolute slot number
+     */
+    static bool _get_tdma_bcn_asn(HeyMacFrame *frm, uint32_t *r_asn);
+
+    /**
+     * Reads the received frame and its meta-data from the radio,
+     * gives it to the eXtended or command handlers
+     * and puts it in the RX queue.
+     */
+    void _rx_frame(void);
+
+    /**
+     * Returns true if frm is a routed frame that is not for us:
+     * if we are its next hop, it is relayed to the next hop to DstAddr;
+     * otherwise (or if that fails) it is released.
+     */
+    bool _route_rx(HeyMacFrame *frm, HeyMacFrameView const &view);
+
+    /** Command handler.  Records how well a neighbor hears us from its CBCN */
+    void _cbcn_hndlr(hm_cmd_t const *cmd);
+
+    /** Command handler.  Folds a route advertisement into the routing table */
+    void _rte_hndlr(hm_cmd_t const *cmd);
+
+    /** Updates the neighbor table entry of the parsed frame's last hop */
+    void _ngbr_rx(HeyMacFrameView const &view, SX127xRadio::rx_info_t const *info);
+
+    /**
+     * Updates the neighbor table entry of the sender of a single-hop frame
+     * that the header filter dropped, if its SrcAddr is within the sz octets read
+     */
+    void _ngbr_rx_hdr(uint8_t const *hdr, uint8_t sz, SX127xRadio::rx_info_t const *info);
+
+    /**
+     * Returns true if frm is a flood frame that was heard before
+     * (or is our own) and must be dropped.
+     * Otherwise, if frm is a new flood frame with hops left,
+     * schedules a relay copy after a random jitter.
+     */
+    bool _flood_rx(HeyMacFrame *frm, HeyMacFrameView const &view);
+
+    /** Drops the due flood relays whose copies were heard k times */
+    void _drop_suppressed(void);
+
+    /**
+     * Returns true if TX must wait for a pending frame or a CSMA backoff
+     * and fills r_until_ms (if not null) with when the wait ends.
+     */
+    bool _tx_held(uint32_t now_ms, uint32_t *r_until_ms);
+
+    /**
+     * Returns true if the first sz octets of a frame pass the receive filters.
+     * Returns true if sz is too short to tell, so parse() decides.
+     */
+    bool _rx_hdr_wanted(uint8_t const *hdr, uint8_t sz);
+
+    /** Sends a beacon if the beacon period is up and this node may send one */
+    void _bcn_prdc(void);
+
+    /** Adds our CBCN (neighbors) and, with a short address, RTE (routes) */
+    void _bcn_cmds(HeyMacCmd *cmd);
+
     /**
      * Transmit beacon
      * Prepares a HeyMac Beacon Command
@@ -0,0 +1,242 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mbed.h"
+#include "mbedtls/ccm.h"
+
+#include "HeyMac.h"
+#include "HeyMacFrameView.h"
+#include "HeyMacIe.h"
+#include "HeyMacMic.h"
+#include "utl_be.h"
+
+
+HeyMacMic::HeyMacMic()
+{
+    for (uint8_t i = 0; i < HM_MIC_KEY_CNT; i++)
+    {
+        _keys[i].peer_addr = 0;
+        _keys[i].is_long = false;
+        _keys[i].in_use = false;
+        _keys[i].set_cnt = 0;
+        mbedtls_ccm_init(&_keys[i].ccm);
+    }
+    _set_cnt = 0;
+}
+
+HeyMacMic::~HeyMacMic()
+{
+    for (uint8_t i = 0; i < HM_MIC_KEY_CNT; i++)
+    {
+        mbedtls_ccm_free(&_keys[i].ccm);
+    }
+}
+
+
+bool HeyMacMic::set_key(uint16_t peer_addr, uint8_t const key[HM_MIC_KEY_SZ])
+{
+    return _set_key(peer_addr, false, key);
+}
+
+bool HeyMacMic::set_key(uint64_t peer_addr, uint8_t const key[HM_MIC_KEY_SZ])
+{
+    return _set_key(peer_addr, true, key);
+}
+
+void HeyMacMic::clr_key(uint16_t peer_addr)
+{
+    _clr_key(peer_addr, false);
+}
+
+void HeyMacMic::clr_key(uint64_t peer_addr)
+{
+    _clr_key(peer_addr, true);
+}
+
+
+bool HeyMacMic::_set_key(uint64_t peer_addr, bool is_long, uint8_t const key[HM_MIC_KEY_SZ])
+{
+    key_t *k;
+
+    k = _find_key(peer_addr, is_long);
+    if (k == nullptr)
+    {
+        k = _new_key();
+    }
+
+    /* Expand the key schedule once, here, rather than per frame */
+    mbedtls_ccm_free(&k->ccm);
+    mbedtls_ccm_init(&k->ccm);
+    k->peer_addr = peer_addr;
+    k->is_long = is_long;
+    k->set_cnt = _set_cnt++;
+    k->in_use = (0 == mbedtls_ccm_setkey(&k->ccm, MBEDTLS_CIPHER_ID_AES, key, 8 * HM_MIC_KEY_SZ));
+
+    return k->in_use;
+}
+
+void HeyMacMic::_clr_key(uint64_t peer_addr, bool is_long)
+{
+    key_t *k;
+
+    k = _find_key(peer_addr, is_long);
+    if (k != nullptr)
+    {
+        mbedtls_ccm_free(&k->ccm);
+        mbedtls_ccm_init(&k->ccm);
+        k->in_use = false;
+    }
+}
+
+
+bool HeyMacMic::sign(HeyMacFrameView const &view, uint8_t *r_mic)
+{
+    bool success = false;
+    uint8_t nonce[NONCE_SZ];
+    key_t *k;
+    bool is_long;
+    uint64_t const peer_addr = _get_peer_addr(view, &is_long);
+
+    k = _find_key(peer_addr, is_long);
+    if ((k != nullptr) && _get_nonce(view, nonce))
+    {
+        /* Authenticate-only: the frame up to the MIC is the additional data */
+        success = (0 == mbedtls_ccm_star_encrypt_and_tag(
+            &k->ccm, 0, nonce, NONCE_SZ,
+            view.get_frm(), view.get_mic() - view.get_frm(),
+            nullptr, nullptr, r_mic, view.get_mic_sz()));
+    }
+    return success;
+}
+
+bool HeyMacMic::verify(HeyMacFrameView const &view)
+{
+    bool is_long;
+    uint64_t const peer_addr = _get_peer_addr(view, &is_long);
+
+    return _verify_with(_find_key(peer_addr, is_long), view);
+}
+
+uint8_t HeyMacMic::verify_batch(HeyMacFrameView const *const views[], uint8_t cnt, bool r_ok[])
+{
+    uint8_t ok_cnt = 0;
+    uint64_t peer_addr;
+    uint64_t prev_peer_addr = 0;
+    bool is_long;
+    bool prev_is_long = false;
+    key_t *k = nullptr;
+
+    for (uint8_t i = 0; i < cnt; i++)
+    {
+        /* Only search the key cache when the sender changes */
+        peer_addr = _get_peer_addr(*views[i], &is_long);
+        if ((i == 0) || (peer_addr != prev_peer_addr) || (is_long != prev_is_long))
+        {
+            k = _find_key(peer_addr, is_long);
+            prev_peer_addr = peer_addr;
+            prev_is_long = is_long;
+        }
+
+        r_ok[i] = _verify_with(k, *views[i]);
+        if (r_ok[i])
+        {
+            ok_cnt++;
+        }
+    }
+    return ok_cnt;
+}
+
+
+// PRIVATE
+
+HeyMacMic::key_t *HeyMacMic::_find_key(uint64_t peer_addr, bool is_long)
+{
+    key_t *k = nullptr;
+
+    for (uint8_t i = 0; i < HM_MIC_KEY_CNT; i++)
+    {
+        if (_keys[i].in_use && (_keys[i].peer_addr == peer_addr) && (_keys[i].is_long == is_long))
+        {
+            k = &_keys[i];
+            break;
+        }
+    }
+    return k;
+}
+
+HeyMacMic::key_t *HeyMacMic::_new_key(void)
+{
+    key_t *k = nullptr;
+
+    for (uint8_t i = 0; i < HM_MIC_KEY_CNT; i++)
+    {
+        if (!_keys[i].in_use)
+        {
+            k = &_keys[i];
+            break;
+        }
+
+        /* The oldest has gone the most sets without being replaced (wrap-safe) */
+        if ((k == nullptr) || ((_set_cnt - _keys[i].set_cnt) > (_set_cnt - k->set_cnt)))
+        {
+            k = &_keys[i];
+        }
+    }
+    return k;
+}
+
+bool HeyMacMic::_get_nonce(HeyMacFrameView const &view, uint8_t r_nonce[NONCE_SZ])
+{
+    bool success = false;
+    uint64_t src_addr;
+    bool is_long;
+    hm_ie_t ie;
+
+    if (view.has_src_addr() && (view.get_mic_sz() > 0))
+    {
+        src_addr = _get_peer_addr(view, &is_long);
+
+        /* Find the MIC IE; its data is the frame counter */
+        HeyMacIeIter iter(view.get_ies(), view.get_ie_sz());
+        while (iter.next(&ie))
+        {
+            if ((HeyMacIe::get_mic_sz(ie.type) > 0) && (ie.sz == 4))
+            {
+                be64_st(&r_nonce[0], src_addr);
+                memcpy(&r_nonce[8], ie.data, 4);
+                r_nonce[12] = ie.type;
+                success = true;
+            }
+        }
+    }
+    return success;
+}
+
+uint64_t HeyMacMic::_get_peer_addr(HeyMacFrameView const &view, bool *r_is_long)
+{
+    uint64_t peer_addr = 0;
+
+    *r_is_long = view.is_long_addr();
+    if (view.has_src_addr())
+    {
+        peer_addr = view.is_long_addr() ? view.get_src_addr_long() : view.get_src_addr_short();
+    }
+    return peer_addr;
+}
+
+bool HeyMacMic::_verify_with(key_t *key, HeyMacFrameView const &view)
+{
+    bool success = false;
+    uint8_t nonce[NONCE_SZ];
+
+    if ((key != nullptr) && _get_nonce(view, nonce))
+    {
+        success = (0 == mbedtls_ccm_star_auth_decrypt(
+            &key->ccm, 0, nonce, NONCE_SZ,
+            view.get_frm(), view.get_mic() - view.get_frm(),
+            nullptr, nullptr, view.get_mic(), view.get_mic_sz()));
+    }
+    return success;
+}
@@ -0,0 +1,105 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#ifndef HEYMACMIC_H_
+#define HEYMACMIC_H_
+
+/**
+ * HeyMacMic
+ *
+ * Message Integrity Code (MIC) for HeyMac frames using AES-CCM*
+ * with authentication only (the payload is not encrypted).
+ *
+ * The MIC authenticates the frame from the PID through the payload.
+ * The multihop fields follow the MIC and are not authenticated
+ * so that relays may update them.
+ *
+ * The 13-octet CCM* nonce is:
+ *   SrcAddr (8 octets, a short addr is zero-extended, MSB first)
+ *   Frame counter from the MIC IE (4 octets, MSB first)
+ *   MIC IE type (1 octet)
+ *
+ * Each peer's key is expanded once by set_key() and the key schedule
+ * is kept for every later sign/verify.  A HeyMacMic instance
+ * is not thread safe; use one per thread.
+ */
+
+#include <stdint.h>
+
+#include "mbedtls/ccm.h"
+
+#include "HeyMac.h"
+#include "HeyMacFrameView.h"
+
+
+class HeyMacMic
+{
+public:
+    HeyMacMic();
+    ~HeyMacMic();
+
+    /**
+     * Expands and caches the key used by the peer with the given SrcAddr.
+     * A short and a long address with the same value are different peers.
+     * If the cache is full, the oldest entry is replaced.
+     * Returns false if the key could not be set.
+     */
+    bool set_key(uint16_t peer_addr, uint8_t const key[HM_MIC_KEY_SZ]);
+    bool set_key(uint64_t peer_addr, uint8_t const key[HM_MIC_KEY_SZ]);
+
+    /** Forgets the key of the given peer */
+    void clr_key(uint16_t peer_addr);
+    void clr_key(uint64_t peer_addr);
+
+    /**
+     * Computes the MIC for the parsed frame and writes it to r_mic.
+     * The frame must have a SrcAddr and a MIC IE.
+     * Returns false if it has neither or the sender's key is unknown.
+     */
+    bool sign(HeyMacFrameView const &view, uint8_t *r_mic);
+
+    /** Returns true if the parsed frame carries a valid MIC */
+    bool verify(HeyMacFrameView const &view);
+
+    /**
+     * Verifies cnt parsed frames; r_ok[i] is the result for views[i].
+     * Consecutive frames from the same peer reuse the key lookup.
+     * Returns the number of frames that verified.
+     */
+    uint8_t verify_batch(HeyMacFrameView const *const views[], uint8_t cnt, bool r_ok[]);
+
+private:
+    enum
+    {
+        NONCE_SZ = 13,
+    };
+
+    typedef struct
+    {
+        uint64_t peer_addr;
+        bool is_long;       /* peer_addr is a long address */
+        bool in_use;
+        uint32_t set_cnt;   /* _set_cnt when the key was set */
+        mbedtls_ccm_context ccm;
+    } key_t;
+
+    key_t _keys[HM_MIC_KEY_CNT];
+    uint32_t _set_cnt;      /* keys set so far */
+
+    key_t *_find_key(uint64_t peer_addr, bool is_long);
+
+    /** Returns an unused entry, or the oldest one if all are in use */
+    key_t *_new_key(void);
+
+    bool _set_key(uint64_t peer_addr, bool is_long, uint8_t const key[HM_MIC_KEY_SZ]);
+    void _clr_key(uint64_t peer_addr, bool is_long);
+
+    /** Fills the nonce from the frame; returns false if the frame has no SrcAddr or MIC IE */
+    static bool _get_nonce(HeyMacFrameView const &view, uint8_t r_nonce[NONCE_SZ]);
+
+    /** Returns the SrcAddr (0 if none) and whether it is long */
+    static uint64_t _get_peer_addr(HeyMacFrameView const &view, bool *r_is_long);
+
+    static bool _verify_with(key_t *key, HeyMacFrameView const &view);
+};
+
+#endif /* HEYMACMIC_H_ */
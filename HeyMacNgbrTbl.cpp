@@ -0,0 +1,451 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mbed.h"
+
+#include "HeyMac.h"
+#include "HeyMacCmd.h"
+#include "HeyMacNgbrTbl.h"
+
+
+MBED_STATIC_ASSERT((HM_NGBR_CNT & (HM_NGBR_CNT - 1)) == 0,
+                   "HM_NGBR_CNT must be a power of two");
+MBED_STATIC_ASSERT(2 * HM_NGBR_CNT < UINT8_MAX, "HM_NGBR_CNT is too big");
+
+/* A sequence number jump larger than this is a restart, not lost frames */
+static uint32_t const SEQ_GAP_MAX = 16;
+
+/* The SNR range (dB) mapped onto link quality 1..15 */
+static int32_t const LQ_SNR_MIN_DB = -20;
+static int32_t const LQ_SNR_MAX_DB = 10;
+static uint8_t const LQ_MAX = 15;
+
+static uint16_t const PRR_ONE_Q8 = 256;
+
+/* Every this many CBCNs carry the full neighbor list */
+static uint8_t const CBCN_FULL_EVERY = 4;
+static uint8_t const CBCN_SEQ_MASK = 0x7F;
+
+
+HeyMacNgbrTbl::HeyMacNgbrTbl()
+{
+    memset(_ngbrs, 0, sizeof(_ngbrs));
+    memset(_short_idx, NONE, sizeof(_short_idx));
+    memset(_long_idx, NONE, sizeof(_long_idx));
+    memset(_prev, NONE, sizeof(_prev));
+    memset(_next, NONE, sizeof(_next));
+    _head = NONE;
+    _tail = NONE;
+    _cnt = 0;
+    _cbcn_prev_cnt = 0;
+    _cbcn_seq = 0;
+    _cbcn_delta_run = CBCN_FULL_EVERY;
+}
+
+HeyMacNgbrTbl::~HeyMacNgbrTbl()
+{
+}
+
+
+hm_ngbr_t const *HeyMacNgbrTbl::heard(uint16_t short_addr, uint64_t long_addr,
+                                      int16_t rssi_dbm, int8_t snr_qdb, uint32_t now_ms,
+                                      bool has_seq, uint32_t seq)
+{
+    hm_ngbr_t *ngbr = nullptr;
+    uint8_t n = NONE;
+    uint8_t slot;
+    uint32_t gap = 0;
+
+    if (short_addr != 0)
+    {
+        n = _short_idx[_idx_find(false, short_addr)];
+    }
+    if ((n == NONE) && (long_addr != 0))
+    {
+        n = _long_idx[_idx_find(true, long_addr)];
+    }
+
+    if ((short_addr != 0) || (long_addr != 0))
+    {
+        if (n == NONE)
+        {
+            n = _alloc();
+            memset(&_ngbrs[n], 0, sizeof(_ngbrs[n]));
+        }
+        else
+        {
+            _unlink(n);
+        }
+        _link_head(n);
+        ngbr = &_ngbrs[n];
+
+        /* Learn an address the entry does not have yet (unless another entry has it) */
+        if ((short_addr != 0) && (ngbr->short_addr == 0))
+        {
+            slot = _idx_find(false, short_addr);
+            if (_short_idx[slot] == NONE)
+            {
+                ngbr->short_addr = short_addr;
+                _short_idx[slot] = n;
+            }
+        }
+        if ((long_addr != 0) && (ngbr->long_addr == 0))
+        {
+            slot = _idx_find(true, long_addr);
+            if (_long_idx[slot] == NONE)
+            {
+                ngbr->long_addr = long_addr;
+                _long_idx[slot] = n;
+            }
+        }
+
+        /* Frames missed since the last sequence number heard */
+        if (has_seq && ngbr->has_seq && ((seq - ngbr->seq) - 1 < SEQ_GAP_MAX))
+        {
+            gap = (seq - ngbr->seq) - 1;
+        }
+        ngbr->lost_cnt += gap;
+        ngbr->seq = seq;
+        ngbr->has_seq = has_seq;
+
+        _updt_lq(ngbr, rssi_dbm, snr_qdb, gap);
+        ngbr->rx_cnt++;
+        ngbr->last_ms = now_ms;
+    }
+    return ngbr;
+}
+
+void HeyMacNgbrTbl::set_short_addr(hm_ngbr_t const *ngbr, uint16_t short_addr)
+{
+    uint8_t const n = ngbr - _ngbrs;
+    uint8_t const slot = _idx_find(false, short_addr);
+
+    MBED_ASSERT(n < _cnt);
+
+    if ((short_addr != 0) && (_short_idx[slot] == NONE))
+    {
+        if (_ngbrs[n].short_addr != 0)
+        {
+            _idx_remove(false, _ngbrs[n].short_addr);
+        }
+        _ngbrs[n].short_addr = short_addr;
+
+        /* The removal may have shifted the slot short_addr goes in */
+        _short_idx[_idx_find(false, short_addr)] = n;
+    }
+}
+
+hm_ngbr_t const *HeyMacNgbrTbl::find_short(uint16_t short_addr)
+{
+    uint8_t const n = _short_idx[_idx_find(false, short_addr)];
+
+    return (n == NONE) ? nullptr : &_ngbrs[n];
+}
+
+hm_ngbr_t const *HeyMacNgbrTbl::find_long(uint64_t long_addr)
+{
+    uint8_t const n = _long_idx[_idx_find(true, long_addr)];
+
+    return (n == NONE) ? nullptr : &_ngbrs[n];
+}
+
+uint8_t HeyMacNgbrTbl::get_cnt(void)
+{
+    return _cnt;
+}
+
+
+uint8_t HeyMacNgbrTbl::get_cbcn_ngbrs(hm_cbcn_ngbr_t *r_ngbrs, uint8_t cnt, uint32_t now_ms, uint32_t max_age_ms)
+{
+    uint8_t filled = 0;
+    uint8_t n;
+    uint8_t i;
+    hm_cbcn_ngbr_t ngbr;
+
+    /* Most recently heard first, so the stalest are left out if cnt is short */
+    for (n = _head; (n != NONE) && (filled < cnt); n = _next[n])
+    {
+        if ((_ngbrs[n].short_addr != 0) && (now_ms - _ngbrs[n].last_ms <= max_age_ms))
+        {
+            /* Insertion sort by address */
+            ngbr.addr = _ngbrs[n].short_addr;
+            ngbr.lq = _ngbrs[n].lq;
+            for (i = filled; (i > 0) && (r_ngbrs[i - 1].addr > ngbr.addr); i--)
+            {
+                r_ngbrs[i] = r_ngbrs[i - 1];
+            }
+            r_ngbrs[i] = ngbr;
+            filled++;
+        }
+    }
+    return filled;
+}
+
+void HeyMacNgbrTbl::get_cbcn_lists(hm_cbcn_lists_t *r_lists, hm_cbcn_ngbr_t *r_ngbrs, uint32_t now_ms, uint32_t max_age_ms)
+{
+    hm_cbcn_ngbr_t cur[HM_NGBR_CNT];
+    hm_cbcn_ngbr_t chg;
+    uint8_t const cur_cnt = get_cbcn_ngbrs(cur, HM_NGBR_CNT, now_ms, max_age_ms);
+    uint8_t i = 0;
+    uint8_t j = 0;
+    uint8_t cnt = 0;
+    bool is_chg;
+    bool delta = (_cbcn_delta_run < CBCN_FULL_EVERY - 1);
+
+    /* Merge the sorted current and previous lists; what differs is the delta */
+    while (delta && ((i < cur_cnt) || (j < _cbcn_prev_cnt)))
+    {
+        is_chg = true;
+        if ((j >= _cbcn_prev_cnt) || ((i < cur_cnt) && (cur[i].addr < _cbcn_prev[j].addr)))
+        {
+            chg = cur[i++];
+        }
+        else if ((i >= cur_cnt) || (_cbcn_prev[j].addr < cur[i].addr))
+        {
+            chg.addr = _cbcn_prev[j++].addr;
+            chg.lq = 0;
+        }
+        else
+        {
+            is_chg = (cur[i].lq != _cbcn_prev[j].lq);
+            chg = cur[i++];
+            j++;
+        }
+
+        if (is_chg)
+        {
+            /* A delta no shorter than the full list is not worth it */
+            delta = (cnt < cur_cnt);
+            if (delta)
+            {
+                r_ngbrs[cnt++] = chg;
+            }
+        }
+    }
+
+    if (delta)
+    {
+        _cbcn_delta_run++;
+    }
+    else
+    {
+        memcpy(r_ngbrs, cur, cur_cnt * sizeof(cur[0]));
+        cnt = cur_cnt;
+        _cbcn_delta_run = 0;
+    }
+    memcpy(_cbcn_prev, cur, cur_cnt * sizeof(cur[0]));
+    _cbcn_prev_cnt = cur_cnt;
+    _cbcn_seq = (_cbcn_seq + 1) & CBCN_SEQ_MASK;
+
+    r_lists->ngbrs = r_ngbrs;
+    r_lists->ngbr_cnt = cnt;
+    r_lists->seq = _cbcn_seq;
+    r_lists->delta = delta;
+}
+
+void HeyMacNgbrTbl::cbcn_rx(hm_ngbr_t const *ngbr, hm_cmd_cbcn_t const *cbcn, uint16_t our_addr)
+{
+    hm_ngbr_t *const n = &_ngbrs[ngbr - _ngbrs];
+    HeyMacCbcnNgbrIter iter(cbcn);
+    hm_cbcn_ngbr_t item;
+    bool listed = false;
+
+    MBED_ASSERT(ngbr - _ngbrs < _cnt);
+
+    if ((cbcn->ngbr_addrs != nullptr) && (our_addr != 0))
+    {
+        /* The list is sorted, so stop once past our address */
+        while (!listed && iter.next(&item) && (item.addr <= our_addr))
+        {
+            listed = (item.addr == our_addr);
+        }
+
+        if (!cbcn->ngbr_delta)
+        {
+            n->lq_out = listed ? item.lq : 0;
+            n->has_cbcn = true;
+        }
+        else if (n->has_cbcn && (cbcn->ngbr_seq == ((n->cbcn_seq + 1) & CBCN_SEQ_MASK)))
+        {
+            if (listed)
+            {
+                n->lq_out = item.lq;
+            }
+        }
+        else
+        {
+            n->has_cbcn = false;
+        }
+        n->cbcn_seq = cbcn->ngbr_seq;
+    }
+}
+
+uint8_t HeyMacNgbrTbl::get_link_lq(hm_ngbr_t const *ngbr)
+{
+    uint8_t lq = ngbr->lq;
+
+    if (ngbr->has_cbcn && (ngbr->lq_out < lq))
+    {
+        lq = ngbr->lq_out;
+    }
+    return lq;
+}
+
+
+// PRIVATE
+
+uint8_t HeyMacNgbrTbl::_idx_find(bool is_long, uint64_t key)
+{
+    uint8_t const *idx = is_long ? _long_idx : _short_idx;
+    uint8_t i = _hash(key);
+
+    /* The index is never more than half full, so an empty slot ends the run */
+    while ((idx[i] != NONE) && (_key(is_long, idx[i]) != key))
+    {
+        i = (i + 1) & (IDX_CNT - 1);
+    }
+    return i;
+}
+
+void HeyMacNgbrTbl::_idx_remove(bool is_long, uint64_t key)
+{
+    uint8_t *idx = is_long ? _long_idx : _short_idx;
+    uint8_t i = _idx_find(is_long, key);
+    uint8_t j = i;
+    uint8_t home;
+
+    /*
+    Backward-shift deletion: move each later entry of the probe run
+    into the hole unless its home slot lies cyclically in (hole, entry]
+    */
+    if (idx[i] != NONE)
+    {
+        for (;;)
+        {
+            j = (j + 1) & (IDX_CNT - 1);
+            if (idx[j] == NONE)
+            {
+                break;
+            }
+            home = _hash(_key(is_long, idx[j]));
+            if (((j - home) & (IDX_CNT - 1)) >= ((j - i) & (IDX_CNT - 1)))
+            {
+                idx[i] = idx[j];
+                i = j;
+            }
+        }
+        idx[i] = NONE;
+    }
+}
+
+uint64_t HeyMacNgbrTbl::_key(bool is_long, uint8_t n)
+{
+    return is_long ? _ngbrs[n].long_addr : _ngbrs[n].short_addr;
+}
+
+uint8_t HeyMacNgbrTbl::_hash(uint64_t key)
+{
+    /* Fibonacci hashing: the top bits of the product are well mixed */
+    return (uint8_t)((key * 0x9E3779B97F4A7C15ULL) >> 56) & (IDX_CNT - 1);
+}
+
+void HeyMacNgbrTbl::_unlink(uint8_t n)
+{
+    if (_prev[n] != NONE)
+    {
+        _next[_prev[n]] = _next[n];
+    }
+    else
+    {
+        _head = _next[n];
+    }
+    if (_next[n] != NONE)
+    {
+        _prev[_next[n]] = _prev[n];
+    }
+    else
+    {
+        _tail = _prev[n];
+    }
+    _prev[n] = NONE;
+    _next[n] = NONE;
+}
+
+void HeyMacNgbrTbl::_link_head(uint8_t n)
+{
+    _prev[n] = NONE;
+    _next[n] = _head;
+    if (_head != NONE)
+    {
+        _prev[_head] = n;
+    }
+    _head = n;
+    if (_tail == NONE)
+    {
+        _tail = n;
+    }
+}
+
+uint8_t HeyMacNgbrTbl::_alloc(void)
+{
+    uint8_t n;
+
+    /* Entries are only freed by eviction, so the unused ones are at the end */
+    if (_cnt < HM_NGBR_CNT)
+    {
+        n = _cnt++;
+    }
+    else
+    {
+        n = _tail;
+        _unlink(n);
+        if (_ngbrs[n].short_addr != 0)
+        {
+            _idx_remove(false, _ngbrs[n].short_addr);
+        }
+        if (_ngbrs[n].long_addr != 0)
+        {
+            _idx_remove(true, _ngbrs[n].long_addr);
+        }
+    }
+    return n;
+}
+
+void HeyMacNgbrTbl::_updt_lq(hm_ngbr_t *ngbr, int16_t rssi_dbm, int8_t snr_qdb, uint32_t gap)
+{
+    int32_t lq;
+
+    if (ngbr->rx_cnt == 0)
+    {
+        ngbr->rssi_q4 = rssi_dbm * 16;
+        ngbr->snr_q4 = snr_qdb * 4;
+        ngbr->prr_q8 = PRR_ONE_Q8;
+    }
+    else
+    {
+        ngbr->rssi_q4 += (rssi_dbm * 16 - ngbr->rssi_q4) / 8;
+        ngbr->snr_q4 += (snr_qdb * 4 - ngbr->snr_q4) / 8;
+
+        /* A 0 sample for each lost frame, then a 1 sample for this one */
+        for (; gap > 0; gap--)
+        {
+            ngbr->prr_q8 -= ngbr->prr_q8 / 8;
+        }
+        ngbr->prr_q8 += (PRR_ONE_Q8 - ngbr->prr_q8) / 8;
+    }
+
+    /* SNR sets the link quality, scaled down by the reception ratio */
+    lq = ((ngbr->snr_q4 - LQ_SNR_MIN_DB * 16) * LQ_MAX) / ((LQ_SNR_MAX_DB - LQ_SNR_MIN_DB) * 16);
+    lq = (lq * ngbr->prr_q8) / PRR_ONE_Q8;
+    if (lq < 1)
+    {
+        lq = 1;
+    }
+    if (lq > LQ_MAX)
+    {
+        lq = LQ_MAX;
+    }
+    ngbr->lq = (uint8_t)lq;
+}
@@ -0,0 +1,161 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#ifndef HEYMACNGBRTBL_H_
+#define HEYMACNGBRTBL_H_
+
+/**
+ * HeyMacNgbrTbl
+ *
+ * A fixed-capacity table of the nodes heard directly (one hop away).
+ * Entries live in one array; two open-addressing hash indexes
+ * (linear probing, half full at most) map a short or a long address
+ * to an entry in O(1), and an intrusive doubly linked list keeps
+ * the entries in least-recently-heard order so the LRU entry
+ * is evicted in O(1) when the table is full.
+ *
+ * Link quality is tracked per neighbor with EWMAs (alpha = 1/8,
+ * in 1/16 units) of RSSI, SNR and the packet reception ratio,
+ * which is estimated from the gaps in the HM_IE_SEQ sequence numbers.
+ * A neighbor's CBCN tells how well it hears us (lq_out),
+ * so a link's quality can be judged both ways.
+ *
+ * Our own CBCN neighbor list is sent in full every CBCN_FULL_EVERY
+ * beacons and as a delta (only the changes) in between,
+ * unless the delta would be no shorter than the full list.
+ *
+ * Entries are never merged.  A frame carries either short or long
+ * addresses, so a node that moves from its long address to a short one
+ * gets a second entry; the long-only entry stops being heard and
+ * falls to the tail of the LRU list, where it is the next evicted.
+ * An entry learns its other address only when one frame gives both
+ * or through set_short_addr().
+ */
+
+#include <stdint.h>
+
+#include "HeyMac.h"
+#include "HeyMacCmd.h"
+
+
+/** A neighbor.  An address of 0 means it is not known yet */
+typedef struct
+{
+    uint64_t long_addr;
+    uint16_t short_addr;
+    int16_t rssi_q4;        /* EWMA of RSSI in dBm/16 */
+    int16_t snr_q4;         /* EWMA of SNR in dB/16 */
+    uint16_t prr_q8;        /* EWMA of the reception ratio; 256 is 1.0 */
+    uint32_t last_ms;       /* when a frame was last heard */
+    uint32_t rx_cnt;        /* frames heard */
+    uint32_t lost_cnt;      /* frames missed, from sequence number gaps */
+    uint32_t seq;           /* last sequence number heard */
+    bool has_seq;
+    uint8_t lq;             /* link quality 1..15 (as in a CBCN) */
+    uint8_t lq_out;         /* how well it hears us, from its CBCN; 0 if not at all */
+    uint8_t cbcn_seq;       /* sequence number of its last CBCN neighbor list */
+    bool has_cbcn;          /* lq_out is up to date with its lists */
+} hm_ngbr_t;
+
+
+class HeyMacNgbrTbl
+{
+public:
+    HeyMacNgbrTbl();
+    ~HeyMacNgbrTbl();
+
+    /**
+     * Records a frame heard from a neighbor and updates its link quality.
+     * Either address may be 0 if the frame did not carry it.
+     * If both are given, the entry found by either one learns the other,
+     * unless another entry already has it (entries are not merged).
+     * has_seq and seq give the frame's HM_IE_SEQ, if it had one.
+     * Evicts the least recently heard neighbor if the table is full.
+     * Returns the entry, or nullptr if both addresses are 0.
+     */
+    hm_ngbr_t const *heard(uint16_t short_addr, uint64_t long_addr,
+                           int16_t rssi_dbm, int8_t snr_qdb, uint32_t now_ms,
+                           bool has_seq, uint32_t seq);
+
+    /**
+     * Gives ngbr the short address that it advertises,
+     * unless another entry already has that address
+     */
+    void set_short_addr(hm_ngbr_t const *ngbr, uint16_t short_addr);
+
+    /** Returns the neighbor with the given address or nullptr */
+    hm_ngbr_t const *find_short(uint16_t short_addr);
+    hm_ngbr_t const *find_long(uint64_t long_addr);
+
+    uint8_t get_cnt(void);
+
+    /**
+     * Fills r_ngbrs with up to cnt neighbors that have a short address
+     * and were heard within max_age_ms, sorted by ascending address
+     * as a CBCN requires.  Returns how many were filled.
+     */
+    uint8_t get_cbcn_ngbrs(hm_cbcn_ngbr_t *r_ngbrs, uint8_t cnt, uint32_t now_ms, uint32_t max_age_ms);
+
+    /**
+     * Fills the neighbor fields of r_lists for our next CBCN,
+     * using r_ngbrs (HM_NGBR_CNT entries) for the list:
+     * a full list, or the changes since the last call (D set;
+     * a lost neighbor has link quality 0).  Each call is one beacon.
+     */
+    void get_cbcn_lists(hm_cbcn_lists_t *r_lists, hm_cbcn_ngbr_t *r_ngbrs, uint32_t now_ms, uint32_t max_age_ms);
+
+    /**
+     * Records ngbr's CBCN: its link quality to our_addr, if listed.
+     * A delta list is applied only if it follows the last list heard;
+     * otherwise lq_out is unknown until the next full list.
+     */
+    void cbcn_rx(hm_ngbr_t const *ngbr, hm_cmd_cbcn_t const *cbcn, uint16_t our_addr);
+
+    /**
+     * Returns the link quality both ways: the lower of lq and lq_out
+     * once ngbr's CBCN is known (0 if it does not hear us), else lq
+     */
+    static uint8_t get_link_lq(hm_ngbr_t const *ngbr);
+
+private:
+    static uint8_t const IDX_CNT = 2 * HM_NGBR_CNT;
+    static uint8_t const NONE = UINT8_MAX;
+
+    hm_ngbr_t _ngbrs[HM_NGBR_CNT];
+
+    /* Entry index per hash slot, NONE if empty */
+    uint8_t _short_idx[IDX_CNT];
+    uint8_t _long_idx[IDX_CNT];
+
+    /* LRU list: _head is the most recently heard; free entries are not linked */
+    uint8_t _prev[HM_NGBR_CNT];
+    uint8_t _next[HM_NGBR_CNT];
+    uint8_t _head;
+    uint8_t _tail;
+    uint8_t _cnt;
+
+    /* The neighbor list of our last CBCN, to make the next delta from */
+    hm_cbcn_ngbr_t _cbcn_prev[HM_NGBR_CNT];
+    uint8_t _cbcn_prev_cnt;
+    uint8_t _cbcn_seq;
+    uint8_t _cbcn_delta_run;    /* deltas sent since the last full list */
+
+    /** Returns the hash slot holding the entry for key, or the empty slot it would go in */
+    uint8_t _idx_find(bool is_long, uint64_t key);
+    void _idx_remove(bool is_long, uint64_t key);
+    uint64_t _key(bool is_long, uint8_t n);
+    static uint8_t _hash(uint64_t key);
+
+    /** Unlinks entry n from the LRU list */
+    void _unlink(uint8_t n);
+
+    /** Links entry n at the head of the LRU list */
+    void _link_head(uint8_t n);
+
+    /** Returns a free entry, evicting the LRU entry if needed */
+    uint8_t _alloc(void);
+
+    /** Folds one received frame (after gap lost ones) into the EWMAs */
+    static void _updt_lq(hm_ngbr_t *ngbr, int16_t rssi_dbm, int8_t snr_qdb, uint32_t gap);
+};
+
+#endif /* HEYMACNGBRTBL_H_ */
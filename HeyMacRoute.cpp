@@ -0,0 +1,276 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mbed.h"
+
+#include "HeyMac.h"
+#include "HeyMacCmd.h"
+#include "HeyMacRoute.h"
+
+
+MBED_STATIC_ASSERT((HM_ROUTE_CACHE_CNT & (HM_ROUTE_CACHE_CNT - 1)) == 0,
+                   "HM_ROUTE_CACHE_CNT must be a power of two");
+MBED_STATIC_ASSERT(HM_ROUTE_CNT < UINT8_MAX, "HM_ROUTE_CNT is too big");
+
+/* The cost of the best link; a hop always costs at least this */
+static uint8_t const LINK_COST_MIN = 1;
+static uint8_t const LQ_MAX = 15;
+
+MBED_STATIC_ASSERT(LINK_COST_MIN + LQ_MAX - 1 == HeyMacRoute::LINK_COST_MAX,
+                   "LINK_COST_MAX must be the cost of an lq 1 link");
+MBED_STATIC_ASSERT(HeyMacRoute::METRIC_INF < UINT8_MAX, "METRIC_INF must fit the metric");
+
+
+HeyMacRoute::HeyMacRoute()
+{
+    memset(_rtes, 0, sizeof(_rtes));
+    memset(_cache, 0, sizeof(_cache));
+    memset(&_stats, 0, sizeof(_stats));
+    _addr = 0;
+}
+
+HeyMacRoute::~HeyMacRoute()
+{
+}
+
+
+void HeyMacRoute::set_addr(uint16_t short_addr)
+{
+    uint8_t const i = _find(short_addr);
+
+    _addr = short_addr;
+    if (i != NONE)
+    {
+        _remove(i);
+    }
+}
+
+uint8_t HeyMacRoute::link_cost(uint8_t lq)
+{
+    /* 1 for the best link up to 15 for the worst */
+    return (lq >= LQ_MAX) ? LINK_COST_MIN : LINK_COST_MIN + LQ_MAX - lq;
+}
+
+void HeyMacRoute::adv_rx(hm_cmd_rte_t const *rte, uint8_t link_cost, uint32_t now_ms)
+{
+    hm_rte_adv_t adv;
+    uint8_t i;
+    uint8_t metric;
+
+    /* The advertiser itself is one link away */
+    _updt(rte->src, rte->src, link_cost, now_ms);
+
+    for (i = 0; i < rte->rte_cnt; i++)
+    {
+        HeyMacCmd::get_rte(rte, i, &adv);
+
+        /* A route through us is no route for us */
+        if ((adv.next_hop == _addr) || (adv.metric >= METRIC_INF - link_cost))
+        {
+            metric = METRIC_INF;
+        }
+        else
+        {
+            metric = adv.metric + link_cost;
+        }
+        _updt(adv.dst, rte->src, metric, now_ms);
+    }
+}
+
+bool HeyMacRoute::get_next_hop(uint16_t dst, uint16_t *r_next_hop)
+{
+    cache_t *const c = &_cache[dst & (HM_ROUTE_CACHE_CNT - 1)];
+    bool found = false;
+    uint8_t i;
+
+    if ((dst != 0) && (c->dst == dst))
+    {
+        _stats.hit_cnt++;
+        *r_next_hop = c->next_hop;
+        found = true;
+    }
+    else
+    {
+        _stats.miss_cnt++;
+        i = _find(dst);
+        if (i != NONE)
+        {
+            c->dst = dst;
+            c->next_hop = _rtes[i].next_hop;
+            *r_next_hop = c->next_hop;
+            found = true;
+        }
+        else
+        {
+            _stats.no_route_cnt++;
+        }
+    }
+    return found;
+}
+
+void HeyMacRoute::expire(uint32_t now_ms, uint32_t max_age_ms)
+{
+    uint8_t i;
+
+    for (i = 0; i < HM_ROUTE_CNT; i++)
+    {
+        if ((_rtes[i].dst != 0) && (now_ms - _rtes[i].updt_ms > max_age_ms))
+        {
+            _remove(i);
+            _stats.expire_cnt++;
+        }
+    }
+}
+
+uint8_t HeyMacRoute::get_adv(hm_rte_adv_t *r_rtes, uint8_t cnt)
+{
+    uint8_t filled = 0;
+    uint8_t i;
+
+    for (i = 0; (i < HM_ROUTE_CNT) && (filled < cnt); i++)
+    {
+        if (_rtes[i].dst != 0)
+        {
+            r_rtes[filled].dst = _rtes[i].dst;
+            r_rtes[filled].next_hop = _rtes[i].next_hop;
+            r_rtes[filled].metric = _rtes[i].metric;
+            filled++;
+        }
+    }
+    return filled;
+}
+
+void HeyMacRoute::count_fwd(void)
+{
+    _stats.fwd_cnt++;
+}
+
+void HeyMacRoute::get_stats(hm_route_stats_t *r_stats)
+{
+    *r_stats = _stats;
+}
+
+
+// PRIVATE
+
+uint8_t HeyMacRoute::_find(uint16_t dst)
+{
+    uint8_t found = NONE;
+    uint8_t i;
+
+    for (i = 0; (i < HM_ROUTE_CNT) && (found == NONE); i++)
+    {
+        if ((dst != 0) && (_rtes[i].dst == dst))
+        {
+            found = i;
+        }
+    }
+    return found;
+}
+
+uint8_t HeyMacRoute::_alloc(uint8_t metric)
+{
+    uint8_t worst = NONE;
+    uint8_t i;
+
+    for (i = 0; i < HM_ROUTE_CNT; i++)
+    {
+        if (_rtes[i].dst == 0)
+        {
+            worst = i;
+            break;
+        }
+        if ((worst == NONE) || (_rtes[i].metric > _rtes[worst].metric))
+        {
+            worst = i;
+        }
+    }
+
+    /* A full table only gives up a route that is worse than the new one */
+    if ((worst != NONE) && (_rtes[worst].dst != 0))
+    {
+        if (_rtes[worst].metric > metric)
+        {
+            _remove(worst);
+        }
+        else
+        {
+            worst = NONE;
+        }
+    }
+    return worst;
+}
+
+void HeyMacRoute::_updt(uint16_t dst, uint16_t next_hop, uint8_t metric, uint32_t now_ms)
+{
+    uint8_t i;
+
+    if ((dst != 0) && (dst != _addr))
+    {
+        i = _find(dst);
+
+        /* A new destination */
+        if (i == NONE)
+        {
+            if (metric < METRIC_INF)
+            {
+                i = _alloc(metric);
+                if (i != NONE)
+                {
+                    _rtes[i].dst = dst;
+                    _rtes[i].next_hop = next_hop;
+                    _rtes[i].metric = metric;
+                    _rtes[i].updt_ms = now_ms;
+                    _stats.chg_cnt++;
+                }
+            }
+        }
+
+        /* Our next hop's metric changed, for better or worse */
+        else if (_rtes[i].next_hop == next_hop)
+        {
+            if (metric >= METRIC_INF)
+            {
+                _remove(i);
+                _stats.chg_cnt++;
+            }
+            else
+            {
+                if (_rtes[i].metric != metric)
+                {
+                    _rtes[i].metric = metric;
+                    _stats.chg_cnt++;
+                }
+                _rtes[i].updt_ms = now_ms;
+            }
+        }
+
+        /* Another neighbor has a better route */
+        else if (metric < _rtes[i].metric)
+        {
+            _rtes[i].next_hop = next_hop;
+            _rtes[i].metric = metric;
+            _rtes[i].updt_ms = now_ms;
+            _invalidate(dst);
+            _stats.chg_cnt++;
+        }
+    }
+}
+
+void HeyMacRoute::_remove(uint8_t i)
+{
+    _invalidate(_rtes[i].dst);
+    _rtes[i].dst = 0;
+}
+
+void HeyMacRoute::_invalidate(uint16_t dst)
+{
+    cache_t *const c = &_cache[dst & (HM_ROUTE_CACHE_CNT - 1)];
+
+    if (c->dst == dst)
+    {
+        c->dst = 0;
+    }
+}
@@ -0,0 +1,131 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#ifndef HEYMACROUTE_H_
+#define HEYMACROUTE_H_
+
+/**
+ * HeyMacRoute
+ *
+ * Distance-vector routing for multihop (FCTL.M) frames with short addresses.
+ * Each node advertises its metric to every destination it can reach
+ * in an RTE command; a receiver adds the link cost to the advertiser
+ * and keeps, per destination, the neighbor with the lowest metric
+ * as the next hop.  Each advertised route is folded in on its own
+ * (incremental Bellman-Ford), so a change touches only its entry.
+ * Routes that are not refreshed expire.
+ *
+ * Each advertised route carries the advertiser's next hop;
+ * a receiver that is that next hop treats the route as unreachable
+ * (split horizon with poisoned reverse), so two nodes never
+ * route to a lost destination through each other.
+ *
+ * A routed frame's TxAddr holds the next hop: the node that is
+ * to transmit the frame next.  A relay looks up the next hop
+ * for the frame's DstAddr and overwrites TxAddr in place.
+ * A small direct-mapped cache in front of the table
+ * makes that lookup a single compare in the common case.
+ */
+
+#include <stdint.h>
+
+#include "HeyMac.h"
+#include "HeyMacCmd.h"
+
+
+/** A route.  dst 0 means the entry is unused */
+typedef struct
+{
+    uint16_t dst;
+    uint16_t next_hop;
+    uint8_t metric;
+    uint32_t updt_ms;   /* when the route was last advertised */
+} hm_route_t;
+
+/** Routing statistics */
+typedef struct
+{
+    uint32_t hit_cnt;       /* lookups answered by the cache */
+    uint32_t miss_cnt;      /* lookups that searched the table */
+    uint32_t no_route_cnt;  /* lookups that found no route */
+    uint32_t fwd_cnt;       /* frames relayed */
+    uint32_t chg_cnt;       /* routes added, changed or removed */
+    uint32_t expire_cnt;    /* routes removed because they were not refreshed */
+} hm_route_stats_t;
+
+
+class HeyMacRoute
+{
+public:
+    /** The most hops a route may take (as in RIP) */
+    static uint8_t const HOP_MAX = 15;
+
+    /** The cost of the worst link */
+    static uint8_t const LINK_COST_MAX = 15;
+
+    /**
+     * A metric this large means unreachable.  A bound just past
+     * HOP_MAX worst links ends a count to infinity quickly.
+     */
+    static uint8_t const METRIC_INF = (HOP_MAX + 1) * LINK_COST_MAX;
+
+    HeyMacRoute();
+    ~HeyMacRoute();
+
+    /** Sets our own short address, which is never routed to */
+    void set_addr(uint16_t short_addr);
+
+    /** Returns the cost of a link with the given CBCN link quality (1..15) */
+    static uint8_t link_cost(uint8_t lq);
+
+    /**
+     * Folds in the route advertisement rte
+     * from the neighbor that is link_cost away
+     */
+    void adv_rx(hm_cmd_rte_t const *rte, uint8_t link_cost, uint32_t now_ms);
+
+    /**
+     * Returns true and fills r_next_hop with the next hop to dst,
+     * or returns false if there is no route
+     */
+    bool get_next_hop(uint16_t dst, uint16_t *r_next_hop);
+
+    /** Removes the routes not advertised within max_age_ms */
+    void expire(uint32_t now_ms, uint32_t max_age_ms);
+
+    /** Fills r_rtes with up to cnt routes to advertise; returns how many */
+    uint8_t get_adv(hm_rte_adv_t *r_rtes, uint8_t cnt);
+
+    void count_fwd(void);
+    void get_stats(hm_route_stats_t *r_stats);
+
+private:
+    static uint8_t const NONE = UINT8_MAX;
+
+    typedef struct
+    {
+        uint16_t dst;       /* 0 if empty */
+        uint16_t next_hop;
+    } cache_t;
+
+    hm_route_t _rtes[HM_ROUTE_CNT];
+    cache_t _cache[HM_ROUTE_CACHE_CNT];
+    uint16_t _addr;
+    hm_route_stats_t _stats;
+
+    /** Returns the index of the route to dst or NONE */
+    uint8_t _find(uint16_t dst);
+
+    /** Returns a free entry, or the worst one if its metric is above metric, or NONE */
+    uint8_t _alloc(uint8_t metric);
+
+    /** Applies one route to dst via next_hop */
+    void _updt(uint16_t dst, uint16_t next_hop, uint8_t metric, uint32_t now_ms);
+
+    /** Empties entry i and drops it from the cache */
+    void _remove(uint8_t i);
+
+    /** Drops dst from the cache */
+    void _invalidate(uint16_t dst);
+};
+
+#endif /* HEYMACROUTE_H_ */
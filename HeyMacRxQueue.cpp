@@ -0,0 +1,57 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#include <stdint.h>
+
+#include "mbed.h"
+#include "mbed_atomic.h"
+
+#include "HeyMac.h"
+#include "HeyMacRxQueue.h"
+
+
+MBED_STATIC_ASSERT((HM_RX_QUEUE_CNT & (HM_RX_QUEUE_CNT - 1)) == 0,
+    "HM_RX_QUEUE_CNT must be a power of two");
+
+
+HeyMacRxQueue::HeyMacRxQueue()
+{
+    _put_cnt = 0;
+    _get_cnt = 0;
+}
+
+HeyMacRxQueue::~HeyMacRxQueue()
+{
+}
+
+
+bool HeyMacRxQueue::put(hm_rx_rec_t const *rec)
+{
+    bool success = false;
+    uint32_t const put_cnt = _put_cnt;
+
+    if (put_cnt - core_util_atomic_load_u32(&_get_cnt) < HM_RX_QUEUE_CNT)
+    {
+        _recs[put_cnt & (HM_RX_QUEUE_CNT - 1)] = *rec;
+
+        /* Publish the record after it is written */
+        core_util_atomic_store_u32(&_put_cnt, put_cnt + 1);
+        success = true;
+    }
+    return success;
+}
+
+bool HeyMacRxQueue::get(hm_rx_rec_t *r_rec)
+{
+    bool success = false;
+    uint32_t const get_cnt = _get_cnt;
+
+    if (core_util_atomic_load_u32(&_put_cnt) != get_cnt)
+    {
+        *r_rec = _recs[get_cnt & (HM_RX_QUEUE_CNT - 1)];
+
+        /* Free the slot after it is read */
+        core_util_atomic_store_u32(&_get_cnt, get_cnt + 1);
+        success = true;
+    }
+    return success;
+}
@@ -0,0 +1,49 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#ifndef HEYMACRXQUEUE_H_
+#define HEYMACRXQUEUE_H_
+
+/**
+ * HeyMacRxQueue
+ *
+ * A single-producer single-consumer ring of HM_RX_QUEUE_CNT
+ * received frames and their reception meta-data.
+ * The HeyMacLayer thread puts; one upper-layer thread gets.
+ * Lock-free and does not use the heap.
+ */
+
+#include <stdint.h>
+
+#include "HeyMac.h"
+#include "HeyMacFrame.h"
+
+
+/** A received frame and its reception meta-data */
+typedef struct
+{
+    HeyMacFrame *frm;   /* From HeyMacFramePool; the getter must release it */
+    uint32_t hdr_us;    /* us_ticker time of the ValidHeader signal */
+    int16_t rssi_dbm;
+    int8_t snr_qdb;     /* SNR in quarter dB */
+} hm_rx_rec_t;
+
+
+class HeyMacRxQueue
+{
+public:
+    HeyMacRxQueue();
+    ~HeyMacRxQueue();
+
+    /** Returns false if the queue is full */
+    bool put(hm_rx_rec_t const *rec);
+
+    /** Returns true and fills r_rec with the oldest record, or false if empty */
+    bool get(hm_rx_rec_t *r_rec);
+
+private:
+    hm_rx_rec_t _recs[HM_RX_QUEUE_CNT];
+    volatile uint32_t _put_cnt;
+    volatile uint32_t _get_cnt;
+};
+
+#endif /* HEYMACRXQUEUE_H_ */
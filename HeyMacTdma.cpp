@@ -0,0 +1,220 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mbed.h"
+
+#include "HeyMacTdma.h"
+
+
+/*
+Defaults.  A slot fits a full 255 octet frame at SF7/BW250/CR4:6 (~225 ms)
+plus guard time.  The ValidHeader comes after the 12.25 symbol preamble
+and the 8 symbol header (512 us per symbol).
+*/
+static uint8_t const TDMA_SLOT_CNT = 16;
+static uint32_t const TDMA_SLOT_US = 250 * 1000;
+static uint32_t const TDMA_HDR_LAT_US = 10368;
+static uint8_t const TDMA_SYNC_LOSS_CNT = 4;
+
+
+HeyMacTdma::HeyMacTdma()
+{
+    _cfg.slot_cnt = TDMA_SLOT_CNT;
+    _cfg.slot_us = TDMA_SLOT_US;
+    _cfg.hdr_lat_us = TDMA_HDR_LAT_US;
+    _cfg.sync_loss_cnt = TDMA_SYNC_LOSS_CNT;
+    memset(&_stats, 0, sizeof(_stats));
+    memset(_slots, HM_SLOT_IDLE, sizeof(_slots));
+    _slots[HM_TDMA_BCN_SLOT] = HM_SLOT_RX;
+    _synced = false;
+    _is_coord = false;
+    _sf_start_us = 0;
+    _sf_num = 0;
+    _bcn_us = 0;
+}
+
+HeyMacTdma::~HeyMacTdma()
+{
+}
+
+
+void HeyMacTdma::set_cfg(hm_tdma_cfg_t const *cfg)
+{
+    MBED_ASSERT((cfg->slot_cnt > HM_TDMA_BCN_SLOT + 1)
+             && (cfg->slot_cnt <= HM_TDMA_SLOT_MAX)
+             && (cfg->slot_us > cfg->hdr_lat_us)
+             && (cfg->sync_loss_cnt > 0));
+
+    /* The superframe must be well inside the 32-bit us_ticker wrap */
+    MBED_ASSERT((uint64_t)cfg->slot_cnt * cfg->slot_us * cfg->sync_loss_cnt < (1ULL << 31));
+
+    _cfg = *cfg;
+    _synced = false;
+}
+
+void HeyMacTdma::get_cfg(hm_tdma_cfg_t *r_cfg)
+{
+    *r_cfg = _cfg;
+}
+
+void HeyMacTdma::set_slot(uint8_t slot, hm_slot_t8 type)
+{
+    MBED_ASSERT((slot < HM_TDMA_SLOT_MAX) && (type != HM_SLOT_BCN));
+
+    if (slot != HM_TDMA_BCN_SLOT)
+    {
+        _slots[slot] = type;
+    }
+}
+
+hm_slot_t8 HeyMacTdma::get_slot(uint8_t slot)
+{
+    MBED_ASSERT(slot < HM_TDMA_SLOT_MAX);
+
+    return _slots[slot];
+}
+
+void HeyMacTdma::anchor(uint32_t sf_start_us)
+{
+    _sf_start_us = sf_start_us;
+    _sf_num = 0;
+    _synced = true;
+    _is_coord = true;
+    _slots[HM_TDMA_BCN_SLOT] = HM_SLOT_BCN;
+}
+
+void HeyMacTdma::sync(uint32_t bcn_hdr_us, uint32_t asn)
+{
+    uint32_t const bcn_start_us = bcn_hdr_us - _cfg.hdr_lat_us;
+    uint32_t expected_us;
+
+    if (!_is_coord)
+    {
+        /* The drift is measured against the slot 0 nearest the beacon */
+        if (_synced)
+        {
+            _advance(bcn_start_us);
+            expected_us = _sf_start_us;
+            if ((bcn_start_us - _sf_start_us) > _sf_us() / 2)
+            {
+                expected_us += _sf_us();
+            }
+            _stats.drift_last_us = (int32_t)(bcn_start_us - expected_us);
+        }
+        _sf_start_us = bcn_start_us;
+        _sf_num = asn / _cfg.slot_cnt;
+        _bcn_us = bcn_start_us;
+        _synced = true;
+        _stats.sync_cnt++;
+    }
+}
+
+void HeyMacTdma::unsync(void)
+{
+    _synced = false;
+    _is_coord = false;
+    _slots[HM_TDMA_BCN_SLOT] = HM_SLOT_RX;
+}
+
+bool HeyMacTdma::is_synced(uint32_t now_us)
+{
+    if (_synced && !_is_coord
+     && ((int32_t)(now_us - _bcn_us) > (int32_t)(_sf_us() * _cfg.sync_loss_cnt)))
+    {
+        _synced = false;
+        _stats.sync_loss_cnt++;
+    }
+    return _synced;
+}
+
+bool HeyMacTdma::next_slot(uint32_t after_us, uint8_t type_mask, uint8_t *r_slot, uint32_t *r_start_us)
+{
+    bool found = false;
+    uint32_t pos_us;
+    uint32_t start_us;
+    uint8_t slot;
+    uint8_t i;
+
+    if (is_synced(after_us))
+    {
+        /* The slot after the one that holds after_us */
+        _advance(after_us);
+        if ((int32_t)(after_us - _sf_start_us) >= 0)
+        {
+            pos_us = after_us - _sf_start_us;
+            slot = pos_us / _cfg.slot_us;
+            start_us = after_us - (pos_us % _cfg.slot_us);
+        }
+        else
+        {
+            /* The anchor is still ahead; start the search at its slot 0 */
+            slot = _cfg.slot_cnt - 1;
+            start_us = _sf_start_us - _cfg.slot_us;
+        }
+
+        for (i = 0; (i < _cfg.slot_cnt) && !found; i++)
+        {
+            slot = (slot + 1 < _cfg.slot_cnt) ? slot + 1 : 0;
+            start_us += _cfg.slot_us;
+            if (type_mask & (1 << _slots[slot]))
+            {
+                *r_slot = slot;
+                *r_start_us = start_us;
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+uint32_t HeyMacTdma::get_asn(uint32_t start_us)
+{
+    _advance(start_us);
+    return _sf_num * _cfg.slot_cnt + (start_us - _sf_start_us) / _cfg.slot_us;
+}
+
+void HeyMacTdma::count_tx_slot(void)
+{
+    _stats.tx_slot_cnt++;
+}
+
+void HeyMacTdma::count_rx_win(bool heard)
+{
+    _stats.rx_win_cnt++;
+    if (!heard)
+    {
+        _stats.rx_tmout_cnt++;
+    }
+}
+
+void HeyMacTdma::get_stats(hm_tdma_stats_t *r_stats)
+{
+    *r_stats = _stats;
+}
+
+
+// PRIVATE
+
+uint32_t HeyMacTdma::_sf_us(void)
+{
+    return _cfg.slot_cnt * _cfg.slot_us;
+}
+
+void HeyMacTdma::_advance(uint32_t now_us)
+{
+    int32_t const elapsed_us = (int32_t)(now_us - _sf_start_us);
+    uint32_t n;
+
+    /*
+    The anchor is kept within a superframe of now
+    so the 32-bit differences never wrap
+    */
+    if (elapsed_us >= (int32_t)_sf_us())
+    {
+        n = (uint32_t)elapsed_us / _sf_us();
+        _sf_start_us += n * _sf_us();
+        _sf_num += n;
+    }
+}
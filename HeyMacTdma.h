@@ -0,0 +1,129 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#ifndef HEYMACTDMA_H_
+#define HEYMACTDMA_H_
+
+/**
+ * HeyMacTdma
+ *
+ * The slot schedule for the TDMA_V0 protocol.
+ * Time is divided into superframes of slot_cnt fixed-length slots.
+ * Slot 0 of every superframe carries the coordinator's beacon;
+ * a member anchors its superframe on the header timestamp
+ * of each beacon it receives, so its slot clock follows the coordinator.
+ *
+ * The slot-allocation table says what this node does in each slot:
+ * nothing (the radio idles), transmit, or open a receive window.
+ *
+ * This class holds the table, the anchor and the statistics;
+ * HeyMacLayer drives the radio and the slot timer.
+ * Times are in microseconds of the us_ticker and wrap at 32 bits.
+ */
+
+#include <stdint.h>
+
+
+/** The most slots in a superframe */
+static uint8_t const HM_TDMA_SLOT_MAX = 64;
+
+/** The slot that carries the beacon */
+static uint8_t const HM_TDMA_BCN_SLOT = 0;
+
+/** What this node does in a slot */
+typedef enum
+{
+    HM_SLOT_IDLE = 0,   /* unallocated or another pair's slot */
+    HM_SLOT_TX,         /* this node transmits */
+    HM_SLOT_RX,         /* a neighbor transmits; open a receive window */
+    HM_SLOT_BCN,        /* this node is the coordinator and sends the beacon */
+} hm_slot_t8;
+
+/** TDMA configuration */
+typedef struct
+{
+    uint8_t slot_cnt;       /* slots per superframe (including the beacon slot) */
+    uint32_t slot_us;       /* duration of one slot; must fit the longest frame */
+    uint32_t hdr_lat_us;    /* time from TX start to the receiver's ValidHeader */
+    uint8_t sync_loss_cnt;  /* superframes without a beacon before sync is lost */
+} hm_tdma_cfg_t;
+
+/** TDMA statistics */
+typedef struct
+{
+    uint32_t sync_cnt;      /* beacons the superframe was anchored on */
+    uint32_t sync_loss_cnt; /* times sync was lost for want of a beacon */
+    int32_t drift_last_us;  /* beacon time minus its expected time */
+    uint32_t tx_slot_cnt;   /* frames sent in a TX slot */
+    uint32_t rx_win_cnt;    /* receive windows opened */
+    uint32_t rx_tmout_cnt;  /* receive windows that heard no preamble */
+} hm_tdma_stats_t;
+
+
+class HeyMacTdma
+{
+public:
+    HeyMacTdma();
+    ~HeyMacTdma();
+
+    /** Changing the configuration loses sync */
+    void set_cfg(hm_tdma_cfg_t const *cfg);
+    void get_cfg(hm_tdma_cfg_t *r_cfg);
+
+    /** Allocates a slot.  The beacon slot is set by anchor() and unsync() */
+    void set_slot(uint8_t slot, hm_slot_t8 type);
+    hm_slot_t8 get_slot(uint8_t slot);
+
+    /**
+     * Makes this node the coordinator and sets the start of slot 0.
+     * The coordinator's superframe is never lost.
+     */
+    void anchor(uint32_t sf_start_us);
+
+    /**
+     * Re-anchors on a beacon whose ValidHeader came at bcn_hdr_us
+     * and that carries the coordinator's absolute slot number
+     */
+    void sync(uint32_t bcn_hdr_us, uint32_t asn);
+
+    /** Forgets the anchor and the coordinator role */
+    void unsync(void);
+
+    /**
+     * Returns true if the superframe is anchored.
+     * A member loses sync after sync_loss_cnt superframes without a beacon.
+     */
+    bool is_synced(uint32_t now_us);
+
+    /**
+     * Returns true and fills r_slot and r_start_us with the first slot
+     * that starts after after_us and whose type is in type_mask
+     * (a bit per hm_slot_t8), searching one superframe ahead.
+     * Returns false if not synced or no slot matches.
+     */
+    bool next_slot(uint32_t after_us, uint8_t type_mask, uint8_t *r_slot, uint32_t *r_start_us);
+
+    /** Returns the absolute slot number of the slot that starts at start_us */
+    uint32_t get_asn(uint32_t start_us);
+
+    /** Statistics are counted by the layer */
+    void count_tx_slot(void);
+    void count_rx_win(bool heard);
+    void get_stats(hm_tdma_stats_t *r_stats);
+
+private:
+    hm_tdma_cfg_t _cfg;
+    hm_tdma_stats_t _stats;
+    hm_slot_t8 _slots[HM_TDMA_SLOT_MAX];
+    bool _synced;
+    bool _is_coord;
+    uint32_t _sf_start_us;
+    uint32_t _sf_num;
+    uint32_t _bcn_us;
+
+    uint32_t _sf_us(void);
+
+    /** Moves the anchor up to the superframe that holds now_us */
+    void _advance(uint32_t now_us);
+};
+
+#endif /* HEYMACTDMA_H_ */
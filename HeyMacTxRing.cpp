@@ -0,0 +1,100 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#include <stdint.h>
+
+#include "mbed.h"
+#include "mbed_atomic.h"
+
+#include "HeyMac.h"
+#include "HeyMacTxRing.h"
+
+
+MBED_STATIC_ASSERT((HM_TX_QUEUE_CNT & (HM_TX_QUEUE_CNT - 1)) == 0,
+    "HM_TX_QUEUE_CNT must be a power of two");
+
+
+HeyMacTxRing::HeyMacTxRing()
+{
+    for (uint32_t i = 0; i < HM_TX_QUEUE_CNT; i++)
+    {
+        _slots[i].seq = i;
+    }
+    _enq_pos = 0;
+    _deq_pos = 0;
+    _fail_cnt = 0;
+}
+
+HeyMacTxRing::~HeyMacTxRing()
+{
+}
+
+
+bool HeyMacTxRing::push(HeyMacFrame *frm, uint32_t at_time_ms)
+{
+    bool success = false;
+    bool full = false;
+    slot_t *slot = nullptr;
+    uint32_t pos;
+    int32_t dif;
+
+    pos = core_util_atomic_load_u32(&_enq_pos);
+    while (!success && !full)
+    {
+        slot = &_slots[pos & MASK];
+        dif = (int32_t)(core_util_atomic_load_u32(&slot->seq) - pos);
+
+        /* The slot is free for this position; try to claim it */
+        if (dif == 0)
+        {
+            /* On failure, pos is updated to the current enqueue position */
+            success = core_util_atomic_cas_u32(&_enq_pos, &pos, pos + 1);
+        }
+
+        /* The consumer has not yet emptied the slot from one lap ago */
+        else if (dif < 0)
+        {
+            full = true;
+        }
+
+        /* Another producer claimed this position; catch up */
+        else
+        {
+            pos = core_util_atomic_load_u32(&_enq_pos);
+        }
+    }
+
+    if (success)
+    {
+        slot->tx_data.frm = frm;
+        slot->tx_data.at_time_ms = at_time_ms;
+        core_util_atomic_store_u32(&slot->seq, pos + 1);
+    }
+    else
+    {
+        core_util_atomic_incr_u32(&_fail_cnt, 1);
+    }
+    return success;
+}
+
+bool HeyMacTxRing::pop(HeyMacTxSched::tx_data_t *r_tx_data)
+{
+    bool success = false;
+    slot_t *slot = &_slots[_deq_pos & MASK];
+
+    /* The slot has been published for this position */
+    if (core_util_atomic_load_u32(&slot->seq) == _deq_pos + 1)
+    {
+        *r_tx_data = slot->tx_data;
+
+        /* Free the slot for the producers' next lap */
+        core_util_atomic_store_u32(&slot->seq, _deq_pos + HM_TX_QUEUE_CNT);
+        _deq_pos++;
+        success = true;
+    }
+    return success;
+}
+
+uint32_t HeyMacTxRing::get_fail_cnt(void)
+{
+    return core_util_atomic_load_u32(&_fail_cnt);
+}
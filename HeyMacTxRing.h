@@ -0,0 +1,56 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#ifndef HEYMACTXRING_H_
+#define HEYMACTXRING_H_
+
+/**
+ * HeyMacTxRing
+ *
+ * A bounded multi-producer single-consumer ring of HM_TX_QUEUE_CNT
+ * transmit entries.  push() is lock-free and may be called concurrently
+ * from any thread or ISR; pop() must only be called from one thread
+ * (the HeyMacLayer thread).  Neither uses the heap.
+ *
+ * Each slot has a sequence number that tells producers and the consumer
+ * whose turn it is: a producer claims a slot by advancing the enqueue
+ * position with a CAS, writes the entry, then publishes the slot
+ * by storing its sequence number.
+ */
+
+#include <stdint.h>
+
+#include "HeyMac.h"
+#include "HeyMacTxSched.h"
+
+
+class HeyMacTxRing
+{
+public:
+    HeyMacTxRing();
+    ~HeyMacTxRing();
+
+    /** Returns false (and counts the failure) if the ring is full */
+    bool push(HeyMacFrame *frm, uint32_t at_time_ms);
+
+    /** Returns true and fills r_tx_data with the oldest entry, or false if empty */
+    bool pop(HeyMacTxSched::tx_data_t *r_tx_data);
+
+    /** Returns the number of pushes that failed because the ring was full */
+    uint32_t get_fail_cnt(void);
+
+private:
+    static uint32_t const MASK = HM_TX_QUEUE_CNT - 1;
+
+    typedef struct
+    {
+        volatile uint32_t seq;
+        HeyMacTxSched::tx_data_t tx_data;
+    } slot_t;
+
+    slot_t _slots[HM_TX_QUEUE_CNT];
+    volatile uint32_t _enq_pos;
+    uint32_t _deq_pos;  /* only the consumer touches this */
+    volatile uint32_t _fail_cnt;
+};
+
+#endif /* HEYMACTXRING_H_ */
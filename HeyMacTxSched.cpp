@@ -0,0 +1,175 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mbed.h"
+
+#include "HeyMac.h"
+#include "HeyMacTxSched.h"
+
+
+HeyMacTxSched::HeyMacTxSched()
+{
+    _cnt = 0;
+    _seq = 0;
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+HeyMacTxSched::~HeyMacTxSched()
+{
+}
+
+
+bool HeyMacTxSched::push(HeyMacFrame *frm, uint32_t at_time_ms)
+{
+    bool success = false;
+    uint8_t i;
+    uint8_t parent;
+
+    if (_cnt < HM_TX_QUEUE_CNT)
+    {
+        i = _cnt++;
+        _heap[i].frm = frm;
+        _heap[i].at_time_ms = at_time_ms;
+        _heap[i].seq = _seq++;
+
+        /* Sift up */
+        while (i > 0)
+        {
+            parent = (i - 1) / 2;
+            if (!_is_first(i, parent))
+            {
+                break;
+            }
+            _swap(i, parent);
+            i = parent;
+        }
+        success = true;
+    }
+    return success;
+}
+
+bool HeyMacTxSched::is_empty(void) const
+{
+    return _cnt == 0;
+}
+
+bool HeyMacTxSched::is_full(void) const
+{
+    return _cnt == HM_TX_QUEUE_CNT;
+}
+
+uint32_t HeyMacTxSched::get_next_time(void) const
+{
+    MBED_ASSERT(_cnt > 0);
+    return _heap[0].at_time_ms;
+}
+
+HeyMacFrame *HeyMacTxSched::get_next_frm(void) const
+{
+    MBED_ASSERT(_cnt > 0);
+    return _heap[0].frm;
+}
+
+bool HeyMacTxSched::is_due(uint32_t now_ms) const
+{
+    return (_cnt > 0) && !is_before(now_ms, _heap[0].at_time_ms);
+}
+
+bool HeyMacTxSched::pop_due(uint32_t now_ms, tx_data_t *r_tx_data)
+{
+    bool success = false;
+    uint32_t late_ms;
+
+    if (is_due(now_ms))
+    {
+        _pop(r_tx_data);
+
+        late_ms = now_ms - r_tx_data->at_time_ms;
+        _stats.tx_cnt++;
+        _stats.late_last_ms = late_ms;
+        _stats.late_sum_ms += late_ms;
+        if (late_ms > _stats.late_max_ms)
+        {
+            _stats.late_max_ms = late_ms;
+        }
+        success = true;
+    }
+    return success;
+}
+
+HeyMacFrame *HeyMacTxSched::drop(void)
+{
+    tx_data_t tx_data;
+
+    MBED_ASSERT(_cnt > 0);
+    _pop(&tx_data);
+    return tx_data.frm;
+}
+
+void HeyMacTxSched::get_stats(hm_tx_sched_stats_t *r_stats) const
+{
+    *r_stats = _stats;
+}
+
+bool HeyMacTxSched::is_before(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) < 0;
+}
+
+
+// PRIVATE
+
+void HeyMacTxSched::_pop(tx_data_t *r_tx_data)
+{
+    uint8_t i;
+    uint8_t child;
+
+    *r_tx_data = _heap[0];
+    _heap[0] = _heap[--_cnt];
+
+    /* Sift down */
+    i = 0;
+    for (;;)
+    {
+        child = 2 * i + 1;
+        if (child >= _cnt)
+        {
+            break;
+        }
+        if ((child + 1 < _cnt) && _is_first(child + 1, child))
+        {
+            child++;
+        }
+        if (!_is_first(child, i))
+        {
+            break;
+        }
+        _swap(i, child);
+        i = child;
+    }
+}
+
+bool HeyMacTxSched::_is_first(uint8_t i, uint8_t j) const
+{
+    bool first;
+
+    if (_heap[i].at_time_ms != _heap[j].at_time_ms)
+    {
+        first = is_before(_heap[i].at_time_ms, _heap[j].at_time_ms);
+    }
+    else
+    {
+        first = (int16_t)(_heap[i].seq - _heap[j].seq) < 0;
+    }
+    return first;
+}
+
+void HeyMacTxSched::_swap(uint8_t i, uint8_t j)
+{
+    tx_data_t const tmp = _heap[i];
+
+    _heap[i] = _heap[j];
+    _heap[j] = tmp;
+}
@@ -0,0 +1,97 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#ifndef HEYMACTXSCHED_H_
+#define HEYMACTXSCHED_H_
+
+/**
+ * HeyMacTxSched
+ *
+ * The transmit schedule.  A fixed-capacity binary min-heap of
+ * HM_TX_QUEUE_CNT frames ordered by the time each is to be sent.
+ * Frames with the same time are sent in the order they were pushed.
+ *
+ * Times are in milliseconds of the kernel clock, truncated to 32 bits
+ * and compared so that wrap-around is harmless
+ * (deadlines must be less than 24 days apart).
+ */
+
+#include <stdint.h>
+
+#include "HeyMac.h"
+#include "HeyMacFrame.h"
+
+
+/** Transmit lateness statistics */
+typedef struct
+{
+    uint32_t tx_cnt;        /* frames popped for transmission */
+    uint32_t late_last_ms;  /* how late the last frame went out */
+    uint32_t late_max_ms;   /* the latest any frame went out */
+    uint32_t late_sum_ms;   /* for the mean: late_sum_ms / tx_cnt */
+} hm_tx_sched_stats_t;
+
+
+class HeyMacTxSched
+{
+public:
+    /** An entry in the schedule */
+    typedef struct
+    {
+        HeyMacFrame *frm;
+        uint32_t at_time_ms;
+        uint16_t seq;   /* keeps FIFO order among equal times */
+        // TODO: tx_stngs;
+    } tx_data_t;
+
+    HeyMacTxSched();
+    ~HeyMacTxSched();
+
+    /** Returns false if the schedule is full */
+    bool push(HeyMacFrame *frm, uint32_t at_time_ms);
+
+    bool is_empty(void) const;
+    bool is_full(void) const;
+
+    /** Returns the time of the earliest frame.  Must not be empty */
+    uint32_t get_next_time(void) const;
+
+    /** Returns the earliest frame without removing it.  Must not be empty */
+    HeyMacFrame *get_next_frm(void) const;
+
+    /** Returns true if the earliest frame's time is at or before now_ms */
+    bool is_due(uint32_t now_ms) const;
+
+    /**
+     * Returns true and fills r_tx_data with the earliest frame
+     * if it is due, and records how late it is.
+     * Returns false if no frame is due.
+     */
+    bool pop_due(uint32_t now_ms, tx_data_t *r_tx_data);
+
+    /**
+     * Removes the earliest frame, due or not, and returns it
+     * without counting it as sent.  The caller owns the frame's reference.
+     * Must not be empty.
+     */
+    HeyMacFrame *drop(void);
+
+    /** Copies the lateness statistics into r_stats */
+    void get_stats(hm_tx_sched_stats_t *r_stats) const;
+
+    /** Returns true if time a is before time b (wrap-around safe) */
+    static bool is_before(uint32_t a, uint32_t b);
+
+private:
+    tx_data_t _heap[HM_TX_QUEUE_CNT];
+    uint8_t _cnt;
+    uint16_t _seq;
+    hm_tx_sched_stats_t _stats;
+
+    /** Removes the root of the heap into r_tx_data.  Must not be empty */
+    void _pop(tx_data_t *r_tx_data);
+    /** Returns true if entry i must be sent before entry j */
+    bool _is_first(uint8_t i, uint8_t j) const;
+    void _swap(uint8_t i, uint8_t j);
+};
+
+#endif /* HEYMACTXSCHED_H_ */
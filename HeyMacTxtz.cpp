@@ -0,0 +1,143 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "HeyMacTxtz.h"
+
+
+static uint8_t const TXTZ_ESC = 0x7F;
+static uint8_t const TXTZ_ENTRY = 0x80;
+static uint8_t const TXTZ_ENTRY_MASK = 0x7F;
+
+/**
+ * The dictionary.  Entries are 2 or more characters (a single character
+ * is no smaller as an entry) and the order is part of the format.
+ */
+static char const *const s_dict[TXTZ_ENTRY_MASK + 1] =
+{
+    /*   0 */ "CQ CQ ", "CQ ", "DE ", "73", "QTH", "QSL", "QRZ", "QRP",
+    /*   8 */ "QSO", "RST ", "599", "5NN", "TNX", "TU ", "FB ", "OM ",
+    /*  16 */ "WX ", "ANT", "RIG", "PWR", "GRID", "BEACON", "HEYMAC", "OK",
+    /*  24 */ "ERR", "BATT", "TEMP", "RSSI", "SNR", "UP", "DOWN", "OFF",
+    /*  32 */ "ON ", "ALL", "TEST", "the ", "ing ", "and ", "tion", "ion ",
+    /*  40 */ " of ", "er", "in", "on", "an", "re", "at", "en",
+    /*  48 */ "ed", "es", "or", "is", "it", "to", "ou", "st",
+    /*  56 */ "ar", "te", "al", "le", "nd", "ha", "th", "he",
+    /*  64 */ " t", " a", " s", " i", " w", "e ", "s ", "t ",
+    /*  72 */ "d ", "n ", "y ", ", ", ". ", "THE ", "ING ", "AND ",
+    /*  80 */ "TION", "ER", "IN", "AN", "RE", "AT", "EN", "ND",
+    /*  88 */ "TI", "ES", "OR", "TE", "OF", "ED", "IS", "IT",
+    /*  96 */ "AL", "AR", "ST", "TO", "NT", "NG", "SE", "HA",
+    /* 104 */ "AS", "OU", "IO", "LE", "VE", "CE", "E ", "S ",
+    /* 112 */ "T ", "00", "10", "20", "0 ", "KC", "KD", "KE",
+    /* 120 */ "KF", "KG", "N1", "W1", " /", "/P", "/M", "RA",
+};
+
+
+uint8_t HeyMacTxtz::compress(char const *txt, uint8_t sz, uint8_t *dst, uint8_t dst_sz)
+{
+    uint8_t offset = 0;
+    uint8_t z_sz = 0;
+    uint8_t best;
+    uint8_t best_sz;
+    uint8_t entry_sz;
+    uint8_t c;
+
+    /* Stop as soon as the output is no smaller than the input */
+    if (dst_sz >= sz)
+    {
+        dst_sz = (sz > 0) ? sz - 1 : 0;
+    }
+
+    while ((offset < sz) && (z_sz < dst_sz))
+    {
+        /* Find the longest entry that matches here */
+        best = 0;
+        best_sz = 1;
+        for (uint8_t i = 0; i <= TXTZ_ENTRY_MASK; i++)
+        {
+            if (s_dict[i][0] == txt[offset])
+            {
+                entry_sz = strlen(s_dict[i]);
+                if ((entry_sz > best_sz)
+                 && (entry_sz <= sz - offset)
+                 && (memcmp(s_dict[i], &txt[offset], entry_sz) == 0))
+                {
+                    best = i;
+                    best_sz = entry_sz;
+                }
+            }
+        }
+
+        if (best_sz > 1)
+        {
+            dst[z_sz++] = TXTZ_ENTRY | best;
+            offset += best_sz;
+        }
+        else
+        {
+            c = txt[offset];
+            if (c >= TXTZ_ESC)
+            {
+                if (z_sz + 2 > dst_sz)
+                {
+                    break;
+                }
+                dst[z_sz++] = TXTZ_ESC;
+            }
+            dst[z_sz++] = c;
+            offset++;
+        }
+    }
+
+    return (offset == sz) ? z_sz : 0;
+}
+
+
+HeyMacTxtzDecoder::HeyMacTxtzDecoder(uint8_t const *z, uint8_t sz)
+{
+    _z = z;
+    _sz = sz;
+    _offset = 0;
+    _entry = nullptr;
+}
+
+uint8_t HeyMacTxtzDecoder::read(char *buf, uint8_t buf_sz)
+{
+    uint8_t n = 0;
+    uint8_t c;
+
+    while (n < buf_sz)
+    {
+        if (_entry && *_entry)
+        {
+            buf[n++] = *_entry++;
+        }
+        else if (_offset < _sz)
+        {
+            c = _z[_offset++];
+            if (c & TXTZ_ENTRY)
+            {
+                _entry = s_dict[c & TXTZ_ENTRY_MASK];
+            }
+            else if (c == TXTZ_ESC)
+            {
+                /* An escape at the end has nothing to escape; drop it */
+                if (_offset < _sz)
+                {
+                    buf[n++] = _z[_offset++];
+                }
+            }
+            else
+            {
+                buf[n++] = c;
+            }
+        }
+        else
+        {
+            break;
+        }
+    }
+    return n;
+}
@@ -0,0 +1,61 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#ifndef HEYMACTXTZ_H_
+#define HEYMACTXTZ_H_
+
+/**
+ * HeyMac compressed text (TXTZ)
+ *
+ * A short-string compressor with a static dictionary
+ * of strings that are common in callsigns, status and QSO text.
+ * Each compressed octet is one of:
+ *
+ *   0x00..0x7E  the literal character
+ *   0x7F        escape; the next octet is a literal (any value)
+ *   0x80..0xFF  dictionary entry (octet & 0x7F)
+ *
+ * Neither direction uses the heap.
+ */
+
+#include <stdint.h>
+
+
+class HeyMacTxtz
+{
+public:
+    /**
+     * Compresses sz octets of txt into dst.
+     * Returns the compressed size, or 0 if compression does not
+     * make the text smaller or the result does not fit in dst_sz.
+     */
+    static uint8_t compress(char const *txt, uint8_t sz, uint8_t *dst, uint8_t dst_sz);
+};
+
+
+/**
+ * HeyMacTxtzDecoder
+ *
+ * Decodes compressed text in place, in pieces of any size,
+ * so the caller needs no buffer for the whole text.
+ */
+class HeyMacTxtzDecoder
+{
+public:
+    HeyMacTxtzDecoder(uint8_t const *z, uint8_t sz);
+
+    /**
+     * Decodes up to buf_sz characters into buf (NOT null-terminated).
+     * Returns the number of characters decoded, 0 at the end of the text.
+     */
+    uint8_t read(char *buf, uint8_t buf_sz);
+
+private:
+    uint8_t const *_z;
+    uint8_t _sz;
+    uint8_t _offset;
+
+    /* The rest of a dictionary entry that did not fit in the last read */
+    char const *_entry;
+};
+
+#endif /* HEYMACTXTZ_H_ */
@@ -168,6 +168,12 @@ bool SX127xRadio::stngs_require_sleep(void)
     return (_rdo_stngs[FLD_RDO_LORA_MODE] != _rdo_stngs_applied[FLD_RDO_LORA_MODE]);
 }
 
+bool SX127xRadio::stngs_outstanding(void)
+{
+    return (_rdo_stngs_freq != _rdo_stngs_freq_applied)
+        || (memcmp(_rdo_stngs, _rdo_stngs_applied, sizeof(_rdo_stngs)) != 0);
+}
+
 void SX127xRadio::updt_rng(void)
 {
     uint8_t reg = 0;
@@ -177,6 +183,60 @@ void SX127xRadio::updt_rng(void)
     _rng_raw = (_rng_raw << 1) | (reg & 1);
 }
 
+void SX127xRadio::read_rx_info(rx_info_t *r_info)
+{
+    /* Packet RSSI offsets for the low and high frequency ports */
+    static int16_t const RSSI_OFFSET_LF = -164;
+    static int16_t const RSSI_OFFSET_HF = -157;
+    static uint32_t const HF_PORT_MIN_HZ = 779000000;
+    uint8_t regs[2];
+    int16_t rssi_offset;
+
+    _read(REG_LORA_FIFO_CURR_ADDR, &r_info->fifo_addr);
+    _read(REG_LORA_RX_CNT, &r_info->sz);
+
+    /* PKT_SNR and PKT_RSSI are adjacent */
+    _read(REG_LORA_PKT_SNR, regs, sizeof(regs));
+    r_info->snr_qdb = (int8_t)regs[0];
+
+    rssi_offset = (_rdo_stngs_freq >= HF_PORT_MIN_HZ) ? RSSI_OFFSET_HF : RSSI_OFFSET_LF;
+    r_info->rssi_dbm = rssi_offset + regs[1];
+
+    /* Below the noise floor, the SNR corrects the RSSI (datasheet 5.5.5) */
+    if (r_info->snr_qdb < 0)
+    {
+        r_info->rssi_dbm += r_info->snr_qdb / 4;
+    }
+}
+
+uint32_t SX127xRadio::get_rng_raw(void)
+{
+    return _rng_raw;
+}
+
+/** The caller MUST leave data[0] available for the SPI command; FIFO data will occupy data[1:] */
+void SX127xRadio::read_fifo(uint8_t * const data, uint8_t const fifo_addr, uint16_t const sz)
+{
+    uint8_t const SPI_READ_MASK = (uint8_t)~0x80;
+    uint8_t addr = fifo_addr;
+
+    MBED_ASSERT(sz > 0);
+
+    _write(REG_LORA_FIFO_ADDR_PTR, &addr);
+
+    /* Clock out the command, then read the FIFO in the same transfer */
+    data[0] = REG_RDO_FIFO & SPI_READ_MASK;
+    _spi->write((char*)data, 1, (char*)data, sz);
+}
+
+SX127xRadio::irq_bitf_t SX127xRadio::read_lora_irq_flags(void)
+{
+    uint8_t reg;
+
+    _read(REG_LORA_IRQ_FLAGS, &reg);
+    return (irq_bitf_t)reg;
+}
+
 /** The caller MUST leave data[0] available for the SPI command; FIFO data should occupy data[1:] */
 void SX127xRadio::write_fifo(uint8_t * const data, uint16_t const sz)
 {
@@ -205,6 +205,15 @@ class SX127xRadio
             STNG_LORA_SF_MAX = 12
         } lora_sf_t;
 
+        /** Reception meta-data of the last received packet */
+        typedef struct
+        {
+            uint8_t fifo_addr;  /* FIFO address of the packet's first octet */
+            uint8_t sz;         /* Packet size in octets */
+            int8_t snr_qdb;     /* SNR in quarter dB */
+            int16_t rssi_dbm;   /* Packet RSSI in dBm */
+        } rx_info_t;
+
         /**
          * Initializes the SX127X radio.
          * Performs pin reset to put all regs in known state.
@@ -226,12 +235,38 @@ class SX127xRadio
         /** Returns true if there are any outstanding settings that require Sleep op_mode */
         bool stngs_require_sleep(void);
 
+        /**
+         * Returns true if there are any outstanding settings
+         * (settings that have been set() but not yet written)
+         */
+        bool stngs_outstanding(void);
+
         /** 
          * Updates the raw RNG value.
          * Should be called regularly during RX to get RSSI noise.
          */
         void updt_rng(void);
 
+        /** Returns the raw RNG value (RSSI noise bits) */
+        uint32_t get_rng_raw(void);
+
+        /**
+         * Reads the location, size, RSSI and SNR of the last received packet.
+         * Call after RxDone.
+         */
+        void read_rx_info(rx_info_t *r_info);
+
+        /**
+         * Reads sz - 1 octets from the FIFO, starting at fifo_addr,
+         * into data[1:] in one SPI burst.
+         * data MUST have its first byte open for the spi command.
+         * sz should include the entire length of data.
+         */
+        void read_fifo(uint8_t * const data, uint8_t const fifo_addr, uint16_t const sz);
+
+        /** Reads the IRQ flags register */
+        irq_bitf_t read_lora_irq_flags(void);
+
         /**
          * Writes the given data[1:] into the FIFO reg.
          * data MUST have its first byte open to fill with the spi command.
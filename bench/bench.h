@@ -0,0 +1,44 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+/**
+ * Host benchmarks
+ *
+ * Each bench_*.cpp is a program that times one of the library's
+ * fast paths against the simple way of doing the same work
+ * and checks that both give the same results.
+ * Build and run them from the repository root;
+ * the command is at the top of each file.
+ */
+
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+
+
+/* Results are summed in here so the compiler cannot drop the timed work */
+static volatile uint32_t bench_sink;
+
+/** Calls fn iter_cnt times and returns the mean time of one call in ns */
+template <typename F>
+static double bench_ns(uint32_t iter_cnt, F fn)
+{
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iter_cnt; i++)
+    {
+        fn();
+    }
+    std::chrono::steady_clock::time_point const end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::nano>(end - start).count() / iter_cnt;
+}
+
+/** Prints one comparison as a table row */
+static void bench_print(char const *name, double base_ns, double fast_ns)
+{
+    printf("%-28s %10.1f ns %10.1f ns %7.2fx\n", name, base_ns, fast_ns, base_ns / fast_ns);
+}
+
+#endif /* BENCH_H_ */
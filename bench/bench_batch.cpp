@@ -0,0 +1,153 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+/**
+ * Times HeyMacFrameBatch (parse a burst into a table, then filter
+ * the table) against parsing each frame with its own HeyMacFrameView
+ * and testing its fields in the same loop.
+ *
+ * Build and run from the repository root:
+ *   g++ -O2 -std=gnu++14 -Ibench -I. bench/bench_batch.cpp HeyMacFrameBatch.cpp HeyMacFrameView.cpp HeyMacIe.cpp -o bench_batch && ./bench_batch
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+#include "HeyMacFrame.h"
+#include "HeyMacFrameBatch.h"
+#include "HeyMacFrameView.h"
+
+
+static uint32_t const ITER_CNT = 500000;
+static uint8_t const PAYLD_SZ = 24;
+static uint16_t const NET_ID = 0x4D48;
+static uint16_t const OUR_ADDR = 0x0102;
+
+typedef HeyMacHdr<HM_PIDFLD_CSMA_V0, FCTL_BIT_N | FCTL_BIT_D | FCTL_BIT_S> bench_hdr_t;
+
+
+/** Per-frame way: parse a view and keep the frames sent to dst_addr */
+static uint8_t view_filter_dst(uint8_t const *const frms[], uint8_t const szs[], uint8_t cnt,
+                               uint16_t dst_addr, uint8_t r_idx[])
+{
+    uint8_t match_cnt = 0;
+
+    for (uint8_t i = 0; i < cnt; i++)
+    {
+        HeyMacFrameView view(frms[i], szs[i]);
+
+        if (view.parse() && view.has_dst_addr() && !view.is_long_addr()
+         && (view.get_dst_addr_short() == dst_addr))
+        {
+            r_idx[match_cnt++] = i;
+        }
+    }
+    return match_cnt;
+}
+
+
+/** Per-frame way for three queries: parse once and test all three fields */
+static uint8_t view_filter_3(uint8_t const *const frms[], uint8_t const szs[], uint8_t cnt,
+                             uint8_t r_idx[3][HM_FRM_BATCH_CNT], uint8_t r_cnt[3])
+{
+    r_cnt[0] = r_cnt[1] = r_cnt[2] = 0;
+    for (uint8_t i = 0; i < cnt; i++)
+    {
+        HeyMacFrameView view(frms[i], szs[i]);
+
+        if (view.parse() && !view.is_long_addr())
+        {
+            if (view.has_net_id() && (view.get_net_id() == NET_ID))
+            {
+                r_idx[0][r_cnt[0]++] = i;
+            }
+            if (view.has_dst_addr() && (view.get_dst_addr_short() == OUR_ADDR))
+            {
+                r_idx[1][r_cnt[1]++] = i;
+            }
+            if (view.has_src_addr() && (view.get_src_addr_short() == OUR_ADDR + 1))
+            {
+                r_idx[2][r_cnt[2]++] = i;
+            }
+        }
+    }
+    return r_cnt[0] + r_cnt[1] + r_cnt[2];
+}
+
+
+int main(void)
+{
+    uint8_t bufs[HM_FRM_BATCH_CNT][bench_hdr_t::SZ + PAYLD_SZ];
+    uint8_t const *frms[HM_FRM_BATCH_CNT];
+    uint8_t szs[HM_FRM_BATCH_CNT];
+    uint8_t idx[HM_FRM_BATCH_CNT];
+    uint8_t ref_idx[3][HM_FRM_BATCH_CNT];
+    uint8_t ref_cnt[3];
+    uint8_t cnt;
+    HeyMacFrameBatch batch;
+
+    /* A burst where every fourth frame is to us and every third is from our neighbor */
+    for (uint8_t i = 0; i < HM_FRM_BATCH_CNT; i++)
+    {
+        bench_hdr_t::write(bufs[i],
+                           (i % 3) ? (uint16_t)(0x2000 + i) : (uint16_t)(OUR_ADDR + 1),
+                           (i % 4) ? (uint16_t)(0x3000 + i) : OUR_ADDR,
+                           (i % 5) ? NET_ID : (uint16_t)(NET_ID + 1));
+        memset(&bufs[i][bench_hdr_t::SZ], i, PAYLD_SZ);
+        frms[i] = bufs[i];
+        szs[i] = sizeof(bufs[i]);
+    }
+
+    /* Both ways must agree before they are timed */
+    batch.parse(frms, szs, HM_FRM_BATCH_CNT);
+    view_filter_3(frms, szs, HM_FRM_BATCH_CNT, ref_idx, ref_cnt);
+    if ((batch.filter_net_id(NET_ID, idx) != ref_cnt[0]) || memcmp(idx, ref_idx[0], ref_cnt[0])
+     || (batch.filter_dst_addr(OUR_ADDR, idx) != ref_cnt[1]) || memcmp(idx, ref_idx[1], ref_cnt[1])
+     || (batch.filter_src_addr(OUR_ADDR + 1, idx) != ref_cnt[2]) || memcmp(idx, ref_idx[2], ref_cnt[2]))
+    {
+        printf("filter mismatch\n");
+        return 1;
+    }
+
+    printf("%-28s %13s %13s %8s\n", "16-frame burst", "per-frame", "batch", "speedup");
+
+    double base_ns = bench_ns(ITER_CNT, [&]()
+        {
+            bench_sink += view_filter_dst(frms, szs, HM_FRM_BATCH_CNT, OUR_ADDR, idx);
+        });
+    double fast_ns = bench_ns(ITER_CNT, [&]()
+        {
+            batch.parse(frms, szs, HM_FRM_BATCH_CNT);
+            bench_sink += batch.filter_dst_addr(OUR_ADDR, idx);
+        });
+    bench_print("parse + 1 filter", base_ns, fast_ns);
+
+    base_ns = bench_ns(ITER_CNT, [&]()
+        {
+            bench_sink += view_filter_3(frms, szs, HM_FRM_BATCH_CNT, ref_idx, ref_cnt);
+        });
+    fast_ns = bench_ns(ITER_CNT, [&]()
+        {
+            batch.parse(frms, szs, HM_FRM_BATCH_CNT);
+            cnt = batch.filter_net_id(NET_ID, ref_idx[0]);
+            cnt += batch.filter_dst_addr(OUR_ADDR, ref_idx[1]);
+            cnt += batch.filter_src_addr(OUR_ADDR + 1, ref_idx[2]);
+            bench_sink += cnt;
+        });
+    bench_print("parse + 3 filters", base_ns, fast_ns);
+
+    /* A table that is filtered again, as when querying a capture, is parsed once */
+    base_ns = bench_ns(ITER_CNT, [&]()
+        {
+            bench_sink += view_filter_dst(frms, szs, HM_FRM_BATCH_CNT, OUR_ADDR, idx);
+        });
+    batch.parse(frms, szs, HM_FRM_BATCH_CNT);
+    fast_ns = bench_ns(ITER_CNT, [&]()
+        {
+            bench_sink += batch.filter_dst_addr(OUR_ADDR, idx);
+        });
+    bench_print("re-filter, already parsed", base_ns, fast_ns);
+
+    return 0;
+}
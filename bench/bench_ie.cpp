@@ -0,0 +1,239 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+/**
+ * Times HeyMacIe::scan() (one pass, table lookups) against
+ * a two-pass scan that decodes size codes and MIC types with switches:
+ * one pass to find the end of the list, another to find the MIC IE.
+ * Then times HeyMacFrameView::parse() of IE-heavy frames
+ * against the same frame without IEs (FCTL.I clear).
+ *
+ * Build and run from the repository root:
+ *   g++ -O2 -std=gnu++14 -Ibench -I. bench/bench_ie.cpp HeyMacIe.cpp HeyMacFrameView.cpp -o bench_ie && ./bench_ie
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+#include "HeyMacFrame.h"
+#include "HeyMacFrameView.h"
+#include "HeyMacIe.h"
+
+
+static uint32_t const ITER_CNT = 2000000;
+static uint8_t const LIST_CNT = 5;
+static uint8_t const LIST_SZ_MAX = 128;
+static uint8_t const PAYLD_SZ = 16;
+static uint8_t const MIC_SZ = 8;
+static uint8_t const FRM_SZ_MAX = 2 + LIST_SZ_MAX + 2 + PAYLD_SZ + MIC_SZ;
+
+
+/**
+ * Writes a CSMA frame with a short SrcAddr and PAYLD_SZ octets of payload
+ * to frm; with IEs (and room for their MIC) if ies_sz is not 0.
+ * Returns the frame's size.
+ */
+static uint8_t put_frm(uint8_t *frm, uint8_t const *ies, uint8_t ies_sz)
+{
+    uint8_t sz = 2;
+
+    frm[FRM_IDX_PID] = HM_PIDFLD_CSMA_V0;
+    frm[FRM_IDX_FCTL] = FCTL_BIT_S;
+    if (ies_sz)
+    {
+        frm[FRM_IDX_FCTL] |= FCTL_BIT_I;
+        memcpy(&frm[sz], ies, ies_sz);
+        sz += ies_sz;
+    }
+    be16_st(&frm[sz], 0x0102);
+    sz += 2;
+    memset(&frm[sz], 'p', PAYLD_SZ);
+    sz += PAYLD_SZ;
+    if (ies_sz)
+    {
+        memset(&frm[sz], 0, MIC_SZ);
+        sz += MIC_SZ;
+    }
+    return sz;
+}
+
+
+/** Returns the data size given by a descriptor, 0xFE if variable, 0xFF if reserved */
+static uint8_t ref_data_sz(uint8_t desc)
+{
+    uint8_t data_sz;
+
+    switch (desc >> 5)
+    {
+        case 0: data_sz = 0; break;
+        case 1: data_sz = 1; break;
+        case 2: data_sz = 2; break;
+        case 3: data_sz = 4; break;
+        case 4: data_sz = 8; break;
+        case 5: data_sz = 16; break;
+        case 6: data_sz = 0xFE; break;
+        default: data_sz = 0xFF; break;
+    }
+    return data_sz;
+}
+
+
+/** Returns the offset of the IE after the one at offset, or sz if it runs past sz */
+static uint16_t ref_next(uint8_t const *ies, uint8_t sz, uint16_t offset)
+{
+    uint8_t data_sz = ref_data_sz(ies[offset]);
+
+    if (data_sz == 0xFE)
+    {
+        offset++;
+        data_sz = (offset < sz) ? ies[offset] : 0xFF;
+    }
+    if (data_sz == 0xFF)
+    {
+        offset = sz;
+    }
+    else
+    {
+        offset += 1 + data_sz;
+    }
+    return offset;
+}
+
+
+/** Same results as HeyMacIe::scan(), found in two passes */
+static uint8_t ref_scan(uint8_t const *ies, uint8_t sz, uint8_t *r_mic_sz)
+{
+    uint16_t offset = 0;
+    uint8_t ies_sz = 0;
+    uint8_t mic_sz = 0;
+
+    /* Pass 1: find the terminator */
+    while ((offset < sz) && (ies_sz == 0))
+    {
+        if (ies[offset] == HM_IE_TERM)
+        {
+            ies_sz = offset + 1;
+        }
+        else
+        {
+            offset = ref_next(ies, sz, offset);
+        }
+    }
+
+    /* Pass 2: find the last MIC IE */
+    offset = 0;
+    while ((ies_sz != 0) && (offset < ies_sz - 1))
+    {
+        switch (ies[offset] & 0x1F)
+        {
+            case HM_IE_MIC_32: mic_sz = 4; break;
+            case HM_IE_MIC_64: mic_sz = 8; break;
+            case HM_IE_MIC_128: mic_sz = 16; break;
+            default: break;
+        }
+        offset = ref_next(ies, sz, offset);
+    }
+
+    *r_mic_sz = mic_sz;
+    return ies_sz;
+}
+
+
+int main(void)
+{
+    uint8_t lists[LIST_CNT][LIST_SZ_MAX];
+    uint8_t list_szs[LIST_CNT];
+    uint8_t const seq[2] = {0x12, 0x34};
+    uint8_t const ctr[4] = {0, 0, 0, 1};
+    uint8_t const app[16] = {0};
+    uint8_t const var[5] = {1, 2, 3, 4, 5};
+    uint8_t n;
+    uint8_t sz;
+    uint8_t mic_sz;
+    uint8_t ref_mic_sz;
+
+    /* Lists of 2 to 10 IEs, a MIC IE last as a sender would put it */
+    for (n = 0; n < LIST_CNT; n++)
+    {
+        uint8_t *p = lists[n];
+        uint8_t i;
+
+        sz = HeyMacIe::write(p, LIST_SZ_MAX, HM_IE_SEQ, seq, sizeof(seq));
+        for (i = 0; i < n; i++)
+        {
+            sz += HeyMacIe::write(&p[sz], LIST_SZ_MAX - sz, HM_IE_APP_MIN + i, app, (i & 1) ? 4 : 16);
+            sz += HeyMacIe::write(&p[sz], LIST_SZ_MAX - sz, HM_IE_APP_MIN + 8 + i, var, sizeof(var));
+        }
+        sz += HeyMacIe::write(&p[sz], LIST_SZ_MAX - sz, HM_IE_MIC_64, ctr, sizeof(ctr));
+        p[sz++] = HM_IE_TERM;
+        list_szs[n] = sz;
+
+        /* Both scans must agree before they are timed */
+        if ((HeyMacIe::scan(p, sz, &mic_sz) != ref_scan(p, sz, &ref_mic_sz))
+         || (mic_sz != ref_mic_sz) || (mic_sz != 8))
+        {
+            printf("scan mismatch on list %u\n", n);
+            return 1;
+        }
+    }
+
+    printf("%-28s %13s %13s %8s\n", "IEs list", "two-pass", "scan()", "speedup");
+    for (n = 0; n < LIST_CNT; n++)
+    {
+        uint8_t const *p = lists[n];
+        char name[32];
+
+        sz = list_szs[n];
+        double const base_ns = bench_ns(ITER_CNT, [&]()
+            {
+                bench_sink += ref_scan(p, sz, &ref_mic_sz) + ref_mic_sz;
+            });
+        double const fast_ns = bench_ns(ITER_CNT, [&]()
+            {
+                bench_sink += HeyMacIe::scan(p, sz, &mic_sz) + mic_sz;
+            });
+        snprintf(name, sizeof(name), "%u IEs, %u octets", 2 + 2 * n, sz);
+        bench_print(name, base_ns, fast_ns);
+    }
+
+    /* Whole-frame parse: the IE-free frame is the baseline for the others */
+    uint8_t frm[FRM_SZ_MAX];
+    uint8_t frm_sz = put_frm(frm, nullptr, 0);
+    HeyMacFrameView view(frm, frm_sz);
+
+    if (!view.parse() || view.has_ies() || (view.get_payld_sz() != PAYLD_SZ))
+    {
+        printf("parse failed on the frame without IEs\n");
+        return 1;
+    }
+    double const no_ie_ns = bench_ns(ITER_CNT, [&]()
+        {
+            HeyMacFrameView v(frm, frm_sz);
+            bench_sink += v.parse() + v.get_payld_sz();
+        });
+
+    printf("\n%-28s %13s %13s\n", "HeyMacFrameView::parse()", "per frame", "vs no IEs");
+    printf("%-28s %10.1f ns %10s\n", "no IEs (FCTL.I clear)", no_ie_ns, "-");
+    for (n = 0; n < LIST_CNT; n++)
+    {
+        char name[32];
+
+        frm_sz = put_frm(frm, lists[n], list_szs[n]);
+        HeyMacFrameView check(frm, frm_sz);
+        if (!check.parse() || (check.get_payld_sz() != PAYLD_SZ) || (check.get_mic_sz() != MIC_SZ))
+        {
+            printf("parse failed on the frame with list %u\n", n);
+            return 1;
+        }
+        double const ie_ns = bench_ns(ITER_CNT, [&]()
+            {
+                HeyMacFrameView v(frm, frm_sz);
+                bench_sink += v.parse() + v.get_payld_sz();
+            });
+        snprintf(name, sizeof(name), "%u IEs, %u octets", 2 + 2 * n, list_szs[n]);
+        printf("%-28s %10.1f ns %+10.1f ns\n", name, ie_ns, ie_ns - no_ie_ns);
+    }
+
+    return 0;
+}
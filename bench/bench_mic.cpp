@@ -0,0 +1,119 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+/**
+ * Times HeyMacMic::verify() with the peer's key schedule cached
+ * against expanding the key for every frame (set_key() before each
+ * verify()), and verify_batch() against one verify() per frame.
+ *
+ * Needs the host's mbedtls headers and library (libmbedtls-dev on Debian).
+ * Build and run from the repository root:
+ *   g++ -O2 -std=gnu++14 -Ibench -I. bench/bench_mic.cpp HeyMacMic.cpp HeyMacFrameView.cpp HeyMacIe.cpp -lmbedcrypto -o bench_mic && ./bench_mic
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+#include "HeyMacFrame.h"
+#include "HeyMacFrameView.h"
+#include "HeyMacIe.h"
+#include "HeyMacMic.h"
+
+
+static uint32_t const ITER_CNT = 200000;
+static uint8_t const PAYLD_SZ = 32;
+static uint8_t const MIC_SZ = 8;
+static uint16_t const PEER_ADDR = 0x0102;
+
+/* PID, FCTL, MIC IE (descriptor, counter), terminator, SrcAddr, payload, MIC */
+static uint8_t const IES_OFFSET = 2;
+static uint8_t const SRC_OFFSET = IES_OFFSET + 1 + 4 + 1;
+static uint8_t const PAYLD_OFFSET = SRC_OFFSET + 2;
+static uint8_t const MIC_OFFSET = PAYLD_OFFSET + PAYLD_SZ;
+static uint8_t const FRM_SZ = MIC_OFFSET + MIC_SZ;
+
+
+int main(void)
+{
+    static uint8_t const key[HM_MIC_KEY_SZ] =
+        {0xC0, 0xC1, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xCB, 0xCC, 0xCD, 0xCE, 0xCF};
+    uint8_t frms[HM_FRM_BATCH_CNT][FRM_SZ];
+    HeyMacFrameView const *views[HM_FRM_BATCH_CNT];
+    bool ok[HM_FRM_BATCH_CNT];
+    HeyMacMic mic;
+    uint8_t ctr[4];
+    uint8_t i;
+
+    /* Fill the key cache so each lookup searches it, our peer last */
+    for (i = 1; i < HM_MIC_KEY_CNT; i++)
+    {
+        mic.set_key((uint16_t)(PEER_ADDR + i), key);
+    }
+    mic.set_key(PEER_ADDR, key);
+
+    /* A burst of signed frames from one peer, each with its own frame counter */
+    for (i = 0; i < HM_FRM_BATCH_CNT; i++)
+    {
+        uint8_t *p = frms[i];
+        HeyMacFrameView *view = new HeyMacFrameView(p, FRM_SZ);
+
+        p[FRM_IDX_PID] = HM_PIDFLD_CSMA_V0;
+        p[FRM_IDX_FCTL] = FCTL_BIT_I | FCTL_BIT_S;
+        be32_st(ctr, 1000 + i);
+        HeyMacIe::write(&p[IES_OFFSET], SRC_OFFSET - IES_OFFSET, HM_IE_MIC_64, ctr, sizeof(ctr));
+        p[SRC_OFFSET - 1] = HM_IE_TERM;
+        be16_st(&p[SRC_OFFSET], PEER_ADDR);
+        memset(&p[PAYLD_OFFSET], 'a' + i, PAYLD_SZ);
+
+        views[i] = view;
+        if (!view->parse() || (view->get_mic_sz() != MIC_SZ) || !mic.sign(*view, &p[MIC_OFFSET]))
+        {
+            printf("could not sign frame %u\n", i);
+            return 1;
+        }
+    }
+
+    /* Every way must verify every frame before it is timed */
+    mic.set_key(PEER_ADDR, key);
+    if (!mic.verify(*views[0])
+     || (mic.verify_batch(views, HM_FRM_BATCH_CNT, ok) != HM_FRM_BATCH_CNT))
+    {
+        printf("verify failed\n");
+        return 1;
+    }
+
+    printf("%-28s %13s %13s %8s\n", "MIC-64, 32-octet payload", "base", "fast", "speedup");
+
+    i = 0;
+    double base_ns = bench_ns(ITER_CNT, [&]()
+        {
+            mic.set_key(PEER_ADDR, key);
+            bench_sink += mic.verify(*views[i++ % HM_FRM_BATCH_CNT]);
+        });
+    i = 0;
+    double fast_ns = bench_ns(ITER_CNT, [&]()
+        {
+            bench_sink += mic.verify(*views[i++ % HM_FRM_BATCH_CNT]);
+        });
+    bench_print("verify, key cached", base_ns, fast_ns);
+
+    base_ns = bench_ns(ITER_CNT / HM_FRM_BATCH_CNT, [&]()
+        {
+            for (uint8_t n = 0; n < HM_FRM_BATCH_CNT; n++)
+            {
+                bench_sink += mic.verify(*views[n]);
+            }
+        });
+    fast_ns = bench_ns(ITER_CNT / HM_FRM_BATCH_CNT, [&]()
+        {
+            bench_sink += mic.verify_batch(views, HM_FRM_BATCH_CNT, ok);
+        });
+    bench_print("16 frames, verify_batch()", base_ns, fast_ns);
+
+    for (i = 0; i < HM_FRM_BATCH_CNT; i++)
+    {
+        delete views[i];
+    }
+    return 0;
+}
@@ -0,0 +1,17 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#ifndef BENCH_MBED_H_
+#define BENCH_MBED_H_
+
+/**
+ * The few parts of mbed.h that the benchmarked sources use,
+ * so they build on a host.  Nothing here is for the target.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+
+#define MBED_ASSERT(expr) assert(expr)
+#define MBED_STATIC_ASSERT(expr, msg) static_assert(expr, msg)
+
+#endif /* BENCH_MBED_H_ */
@@ -0,0 +1,92 @@
+/* Copyright 2020 Dean Hall.  See LICENSE for details. */
+
+#ifndef UTL_BE_H_
+#define UTL_BE_H_
+
+/**
+ * Big-endian (network order) load/store of unaligned integers.
+ *
+ * HeyMac sends every multi-octet field MSB first.  On a little-endian
+ * target these compile to an unaligned load/store and a byte-swap
+ * instruction (REV on Cortex-M3 and later, BSWAP on x86).
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define UTL_BE_SWAP16(v) (v)
+#define UTL_BE_SWAP32(v) (v)
+#define UTL_BE_SWAP64(v) (v)
+#elif defined(__GNUC__) || defined(__clang__)
+#define UTL_BE_SWAP16(v) __builtin_bswap16(v)
+#define UTL_BE_SWAP32(v) __builtin_bswap32(v)
+#define UTL_BE_SWAP64(v) __builtin_bswap64(v)
+#else
+/* Other toolchains (ARMCC5, IAR) recognize these shift patterns as REV */
+#define UTL_BE_SWAP16(v) utl_be_swap16(v)
+#define UTL_BE_SWAP32(v) utl_be_swap32(v)
+#define UTL_BE_SWAP64(v) utl_be_swap64(v)
+
+static inline uint16_t utl_be_swap16(uint16_t v)
+{
+    return (uint16_t)((v << 8) | (v >> 8));
+}
+
+static inline uint32_t utl_be_swap32(uint32_t v)
+{
+    return ((v << 24) & 0xFF000000UL)
+         | ((v <<  8) & 0x00FF0000UL)
+         | ((v >>  8) & 0x0000FF00UL)
+         | ((v >> 24) & 0x000000FFUL);
+}
+
+static inline uint64_t utl_be_swap64(uint64_t v)
+{
+    return ((uint64_t)utl_be_swap32((uint32_t)v) << 32)
+         | utl_be_swap32((uint32_t)(v >> 32));
+}
+#endif
+
+
+static inline uint16_t be16_ld(uint8_t const *p)
+{
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return UTL_BE_SWAP16(v);
+}
+
+static inline uint32_t be32_ld(uint8_t const *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return UTL_BE_SWAP32(v);
+}
+
+static inline uint64_t be64_ld(uint8_t const *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return UTL_BE_SWAP64(v);
+}
+
+static inline void be16_st(uint8_t *p, uint16_t v)
+{
+    v = UTL_BE_SWAP16(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline void be32_st(uint8_t *p, uint32_t v)
+{
+    v = UTL_BE_SWAP32(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline void be64_st(uint8_t *p, uint64_t v)
+{
+    v = UTL_BE_SWAP64(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+#endif /* UTL_BE_H_ */